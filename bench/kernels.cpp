@@ -0,0 +1,210 @@
+// Microbenchmarks of the hot kernels of the recognition pipeline.
+// Inputs are synthetic and fixed, so numbers are comparable between builds.
+// Set KNNOCR_BENCH_IMAGE to a captured frame to also time the kernels on it with the
+// ROI layout of config.yml in the working directory.
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cfloat>
+#include <benchmark/benchmark.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "Config.h"
+#include "ImageProcessor.h"
+#include "KNearestOcr.h"
+#include "GlyphBatch.h"
+#include "ChannelValidator.h"
+#include "Log.h"
+
+// Access to the private kernels, see the friend declarations.
+struct KernelAccess {
+	static void setGray(ImageProcessor& proc, const cv::Mat& gray) { proc._imgGray = gray; }
+	static cv::Mat binaryFiltering(ImageProcessor& proc) { return proc.binaryFiltering(); }
+	static void rotate(ImageProcessor& proc, double degrees) { proc.rotate(degrees); }
+	static void findCounterDigits(ImageProcessor& proc, ROIBox* roi) { proc.findCounterDigits(roi); }
+	static cv::Mat prepareSample(KNearestOcr& ocr, const cv::Mat& img) { return ocr.prepareSample(img); }
+};
+
+// A frame with a kV and a mA display of the given height and a power indicator.
+struct SyntheticFrame {
+	cv::Mat gray;
+	ROIBox roi;
+
+	explicit SyntheticFrame(int height) {
+		int width = 3 * height;
+		int power = height / 2;
+		std::vector<cv::Rect> boxes;
+		boxes.push_back(cv::Rect(10, 10, width, height));
+		boxes.push_back(cv::Rect(10, 20 + height, width, height));
+		// the power check reads 3 bytes per pixel, leave room to the right
+		boxes.push_back(cv::Rect(20 + width, 10, power, power));
+		gray = cv::Mat::zeros(30 + 2 * height, 30 + width + 4 * power, CV_8UC1);
+
+		double scale = .6 * height / 22.;
+		int thickness = std::max(1, height / 15);
+		cv::putText(gray, "120", cv::Point(boxes[0].x + 5, boxes[0].y + height * 4 / 5),
+				cv::FONT_HERSHEY_SIMPLEX, scale, cv::Scalar(255), thickness);
+		cv::putText(gray, "25.5", cv::Point(boxes[1].x + 5, boxes[1].y + height * 4 / 5),
+				cv::FONT_HERSHEY_SIMPLEX, scale, cv::Scalar(255), thickness);
+		gray(boxes[2]).setTo(cv::Scalar(255));
+		roi.setROIBox(boxes);
+	}
+};
+
+static ImageProcessor* newProcessor(const Config& config) {
+	ImageProcessor* proc = new ImageProcessor(config);
+	proc->ocrkVmA();
+	proc->debugPower();
+	return proc;
+}
+
+static void BM_BinaryFiltering(benchmark::State& state) {
+	SyntheticFrame frame((int) state.range(0));
+	Config config;
+	std::unique_ptr<ImageProcessor> proc(newProcessor(config));
+	KernelAccess::setGray(*proc, frame.gray);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(KernelAccess::binaryFiltering(*proc));
+	}
+	state.SetItemsProcessed(state.iterations() * frame.gray.total());
+}
+BENCHMARK(BM_BinaryFiltering)->Arg(40)->Arg(80)->Arg(160);
+
+static void BM_Rotate(benchmark::State& state) {
+	SyntheticFrame frame((int) state.range(0));
+	Config config;
+	std::unique_ptr<ImageProcessor> proc(newProcessor(config));
+	for (auto _ : state) {
+		KernelAccess::setGray(*proc, frame.gray);
+		KernelAccess::rotate(*proc, 5.);
+	}
+	state.SetItemsProcessed(state.iterations() * frame.gray.total());
+}
+BENCHMARK(BM_Rotate)->Arg(40)->Arg(80)->Arg(160);
+
+// Thresholding, contours and digit isolation in the ROI boxes.
+static void BM_Segmentation(benchmark::State& state) {
+	SyntheticFrame frame((int) state.range(0));
+	Config config;
+	std::unique_ptr<ImageProcessor> proc(newProcessor(config));
+	KernelAccess::setGray(*proc, frame.gray);
+	for (auto _ : state) {
+		KernelAccess::findCounterDigits(*proc, &frame.roi);
+		benchmark::DoNotOptimize(proc->getGlyphskV().size());
+	}
+}
+BENCHMARK(BM_Segmentation)->Arg(40)->Arg(80)->Arg(160);
+
+static void BM_PrepareSample(benchmark::State& state) {
+	int height = (int) state.range(0);
+	cv::Mat digit = cv::Mat::zeros(height, height / 2, CV_8UC1);
+	cv::rectangle(digit, cv::Rect(1, 1, height / 2 - 2, height - 2), cv::Scalar(255), 2);
+	Config config;
+	KNearestOcr ocr(config);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(KernelAccess::prepareSample(ocr, digit));
+	}
+}
+BENCHMARK(BM_PrepareSample)->Arg(20)->Arg(50)->Arg(90);
+
+// Crop, resize and convert the glyphs of a field into the batch. Argument: glyph height.
+static void BM_GlyphBatchAssign(benchmark::State& state) {
+	int height = (int) state.range(0);
+	int width = height / 2;
+	cv::Mat field = cv::Mat::zeros(height + 4, 4 * (width + 4), CV_8UC1);
+	std::vector<cv::Rect> boxes;
+	for (int i = 0; i < 4; i++) {
+		boxes.push_back(cv::Rect(2 + i * (width + 4), 2, width, height));
+		cv::rectangle(field, boxes.back(), cv::Scalar(255), 2);
+	}
+	GlyphBatch glyphs;
+	for (auto _ : state) {
+		glyphs.assign(field, boxes);
+		benchmark::DoNotOptimize(glyphs.sample(0));
+	}
+	state.SetItemsProcessed(state.iterations() * boxes.size());
+}
+BENCHMARK(BM_GlyphBatchAssign)->Arg(20)->Arg(50)->Arg(90);
+
+// Arguments: model size, 1 to bound the search by ocrMaxDist.
+static void BM_FindNearest(benchmark::State& state) {
+	int rows = (int) state.range(0);
+	cv::RNG rng(42);
+	cv::Mat samples(rows, 100, CV_32F), responses(rows, 1, CV_32F);
+	rng.fill(samples, cv::RNG::UNIFORM, 0., 255.);
+	for (int r = 0; r < rows; r++) {
+		responses.at<float>(r, 0) = (float) (r % 10);
+	}
+	cv::Mat query = samples.row(rows / 2).clone();
+	query += 1.f;
+	float maxDist = state.range(1) ? Config().getOcrMaxDist() : FLT_MAX;
+	KNearestOcr::Neighbor neighbors[3];
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(KNearestOcr::findNearest(samples, responses, query.ptr<float>(0), 3, maxDist, neighbors));
+	}
+	state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_FindNearest)->Args({110, 0})->Args({110, 1})->Args({1000, 0})->Args({1000, 1})->Args({10000, 0})
+		->Args({10000, 1});
+
+// Argument: validator window.
+static void BM_ChannelValidatorCheck(benchmark::State& state) {
+	Config config;
+	ChannelValidator validator("bench", config.getKvRules(), (int) state.range(0));
+	Reading reading = { 0, 0. };
+	for (auto _ : state) {
+		reading.time++;
+		reading.value = 80. + (reading.time % 3);
+		benchmark::DoNotOptimize(validator.check(reading));
+	}
+}
+BENCHMARK(BM_ChannelValidatorCheck)->Arg(5)->Arg(15)->Arg(45);
+
+// The same kernels on a captured frame.
+static void registerCaptured(const char* filename) {
+	static Config config;
+	config.loadConfig();
+	static cv::Mat gray = cv::imread(filename, cv::IMREAD_GRAYSCALE);
+	static ROIBox roi;
+	std::vector<cv::Rect> boxes = config.getRoiBoxes();
+	if (gray.empty() || boxes.size() < 3) {
+		fprintf(stderr, "Skipping captured frame %s: unreadable or no ROI layout in config.yml\n", filename);
+		return;
+	}
+	roi.setROIBox(boxes);
+	benchmark::RegisterBenchmark("BM_BinaryFiltering/captured", [](benchmark::State& state) {
+		std::unique_ptr<ImageProcessor> proc(newProcessor(config));
+		KernelAccess::setGray(*proc, gray);
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(KernelAccess::binaryFiltering(*proc));
+		}
+	});
+	benchmark::RegisterBenchmark("BM_Segmentation/captured", [](benchmark::State& state) {
+		std::unique_ptr<ImageProcessor> proc(newProcessor(config));
+		KernelAccess::setGray(*proc, gray);
+		for (auto _ : state) {
+			KernelAccess::findCounterDigits(*proc, &roi);
+			benchmark::DoNotOptimize(proc->getGlyphskV().size());
+		}
+	});
+}
+
+int main(int argc, char** argv) {
+	Logger::instance().setLevel(Logger::WARN);
+	const char* captured = getenv("KNNOCR_BENCH_IMAGE");
+	if (captured) {
+		registerCaptured(captured);
+	}
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	return 0;
+}
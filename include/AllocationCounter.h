@@ -0,0 +1,13 @@
+#ifndef INCLUDE_ALLOCATIONCOUNTER_H_
+#define INCLUDE_ALLOCATIONCOUNTER_H_
+
+#include <cstdint>
+
+// Number of heap allocations (the malloc family and operator new) made by the process
+// so far. Returns false where allocations are not counted.
+// Each executable links one definition: AllocationCounter.cpp interposes the glibc
+// allocator at one relaxed atomic add per allocation (knnocr-allocs only),
+// NoAllocationCounter.cpp counts nothing. The library defines neither.
+bool allocationCount(uint64_t& count);
+
+#endif /* INCLUDE_ALLOCATIONCOUNTER_H_ */
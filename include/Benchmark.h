@@ -0,0 +1,59 @@
+#ifndef INCLUDE_BENCHMARK_H_
+#define INCLUDE_BENCHMARK_H_
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <opencv2/core/core.hpp>
+
+#include "Config.h"
+#include "Engine.h"
+#include "Metrics.h"
+
+// Runs Engine::process on preloaded frames without GUI and without sleeping.
+// Reports throughput, per stage latency percentiles, peak RSS and heap allocations per frame.
+// The stages are timed by the engine's own stage timers, into metrics of the benchmark.
+class Benchmark {
+public:
+	explicit Benchmark(const Config& config);
+
+	// Load the model and the ROI layout of the config, see Engine::load.
+	bool load() { return _engine.load(); }
+
+	void addFrame(const cv::Mat& frame);
+	// Frame with the kV and mA values it shows, e.g. from a synthetic input.
+	// The report then includes the recognition accuracy.
+	void addFrame(const cv::Mat& frame, double kV, double mA);
+	int getFrameCount() const { return (int) _frames.size(); }
+
+	void run(int frames, int warmup = 10);
+
+	void report(std::ostream& os) const;
+	void writeJson(std::ostream& os) const;
+
+private:
+	enum Stage { PROCESS, RECOGNIZE, VALIDATE, TOTAL, STAGES };
+
+	void processFrame(const cv::Mat& frame, time_t time, double* micros);
+	static bool matches(double value, double truth, const ChannelRules& rules);
+	static double percentile(const std::vector<double>& sorted, double p);
+	static const char* stageName(int stage);
+
+	Config _config;
+	Metrics _metrics; // stage timers of the engine, kept apart from the exported metrics
+	Engine _engine;
+	std::vector<cv::Mat> _frames;
+	std::vector<cv::Vec2d> _truth; // kV and mA per frame, NaN if unknown
+	FrameResult _result;
+
+	std::vector<double> _micros[STAGES]; // sorted after run
+	int _measured;
+	double _seconds;
+	long _peakRssKb;
+	int _labeled;    // measured frames with known values
+	int _kVCorrect;
+	int _mACorrect;
+	double _allocationsPerFrame; // negative if not available
+};
+
+#endif /* INCLUDE_BENCHMARK_H_ */
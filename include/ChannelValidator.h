@@ -0,0 +1,64 @@
+#ifndef INCLUDE_CHANNELVALIDATOR_H_
+#define INCLUDE_CHANNELVALIDATOR_H_
+
+#include <string>
+#include <deque>
+#include <set>
+#include <ctime>
+#include <cstdint>
+
+#include "Config.h"
+#include "Metrics.h"
+
+// A numeric reading of one display channel.
+struct Reading {
+	time_t time;
+	double value;
+};
+
+// Streaming plausibility check of one display channel (kV, mA).
+// A reading must be in range; the window of the last readings must be stable and its
+// median must not change faster than allowed since the last accepted value.
+// The window is kept as quantized values split into a lower and an upper half, so
+// min, max and median are at the ends of the halves and an update costs O(log window)
+// however far the value jumps.
+class ChannelValidator {
+public:
+	enum Status { ACCEPTED, PENDING, REJECTED_PARSE, REJECTED_RANGE, REJECTED_UNSTABLE, REJECTED_RATE };
+
+	ChannelValidator(const std::string& name, const ChannelRules& rules, int window = 5,
+			Metrics& metrics = Metrics::instance());
+
+	Status check(const std::string& digits, time_t time);
+	Status check(const Reading& reading);
+
+	double getCheckedValue() const { return _checked.value; }
+	time_t getCheckedTime() const { return _checked.time; }
+	bool hasCheckedValue() const { return _hasChecked; }
+	const std::string& getName() const { return _name; }
+
+	static bool parse(const std::string& digits, double resolution, double& value);
+	static const char* statusName(Status status);
+
+private:
+	Status report(Status status, const Reading& reading);
+	int bin(double value) const;
+	void push(const Reading& reading);
+	void pop();
+	void balance();
+
+	std::string _name;
+	ChannelRules _rules;
+	int _window;
+
+	std::deque<int> _values;  // bins in arrival order
+	std::multiset<int> _lower; // the lower half of the bins, the lower median last
+	std::multiset<int> _upper; // the rest, none smaller than a lower bin
+
+	Reading _checked;
+	bool _hasChecked;
+
+	Counter* _statusCounters; // indexed by Status, null if not instrumented
+};
+
+#endif /* INCLUDE_CHANNELVALIDATOR_H_ */
@@ -2,6 +2,17 @@
 #define CONFIG_H_
 
 #include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// Plausibility rules of a display channel.
+struct ChannelRules {
+    double minValue;
+    double maxValue;
+    double maxRate;     // max change per second of accepted values, 0 = off
+    double stableDelta; // max spread of the values in the window, 0 = off
+    double resolution;  // value of the last digit
+};
 
 class Config {
 public:
@@ -45,6 +56,135 @@ public:
     	return _binaryThreshold;
     }
 
+    std::string getOcrEngine() const {
+        return _ocrEngine;
+    }
+
+    std::string getSegmentGeometry() const {
+        return _segmentGeometry;
+    }
+
+    const ChannelRules& getKvRules() const {
+        return _kVRules;
+    }
+
+    const ChannelRules& getMaRules() const {
+        return _mARules;
+    }
+
+    int getValidatorWindow() const {
+        return _validatorWindow;
+    }
+
+    std::string getStoreDirectory() const {
+        return _storeDirectory;
+    }
+
+    int getStoreBatchSize() const {
+        return _storeBatchSize;
+    }
+
+    std::string getStoreFsync() const {
+        return _storeFsync;
+    }
+
+    int getStoreFsyncInterval() const {
+        return _storeFsyncInterval;
+    }
+
+    std::string getRecordFile() const {
+        return _recordFile;
+    }
+
+    int getRecordQueueSize() const {
+        return _recordQueueSize;
+    }
+
+    std::string getRecordDropPolicy() const {
+        return _recordDropPolicy;
+    }
+
+    int getRecordMaxMB() const {
+        return _recordMaxMB;
+    }
+
+    int getRecordMaxMinutes() const {
+        return _recordMaxMinutes;
+    }
+
+    // Rotated recordings kept, older ones are deleted; 0 keeps all.
+    int getRecordKeepFiles() const {
+        return _recordKeepFiles;
+    }
+
+    bool getRecordRoiOnly() const {
+        return _recordRoiOnly != 0;
+    }
+
+    std::string getBusName() const {
+        return _busName;
+    }
+
+    int getBusCapacity() const {
+        return _busCapacity;
+    }
+
+    int getMetricsPort() const {
+        return _metricsPort;
+    }
+
+    std::string getMetricsFile() const {
+        return _metricsFile;
+    }
+
+    std::string getTraceFile() const {
+        return _traceFile;
+    }
+
+    int getTraceEvents() const {
+        return _traceEvents;
+    }
+
+    int getFrameIdlePeriod() const {
+        return _frameIdlePeriod;
+    }
+
+    int getFrameHoldTime() const {
+        return _frameHoldTime;
+    }
+
+    // Frames with an unchanged digit layout before the segmentation crops the learned cells, 0 to always segment.
+    int getSegmentLearnFrames() const {
+        return _segmentLearnFrames;
+    }
+
+    std::string getFlightDirectory() const {
+        return _flightDirectory;
+    }
+
+    // Seconds of frames kept by the flight recorder, 0 to disable it.
+    int getFlightSeconds() const {
+        return _flightSeconds;
+    }
+
+    // Seconds recorded after a trigger before the window is written.
+    int getFlightPostSeconds() const {
+        return _flightPostSeconds;
+    }
+
+    bool getFlightRoiOnly() const {
+        return _flightRoiOnly != 0;
+    }
+
+    // ROI layout: kV display, mA display, ..., power indicator last.
+    const std::vector<cv::Rect>& getRoiBoxes() const {
+        return _roiBoxes;
+    }
+
+    void setRoiBoxes(const std::vector<cv::Rect>& roiBoxes) {
+        _roiBoxes = roiBoxes;
+    }
+
 
 private:
     int _rotationDegrees;
@@ -56,6 +196,36 @@ private:
     int _cannyThreshold2;
     int _binaryThreshold;
     std::string _trainingDataFilename;
+    std::string _ocrEngine;
+    std::string _segmentGeometry;
+    ChannelRules _kVRules;
+    ChannelRules _mARules;
+    int _validatorWindow;
+    std::string _storeDirectory;
+    int _storeBatchSize;
+    std::string _storeFsync;
+    int _storeFsyncInterval;
+    std::string _recordFile;
+    int _recordQueueSize;
+    std::string _recordDropPolicy;
+    int _recordMaxMB;
+    int _recordMaxMinutes;
+    int _recordKeepFiles;
+    int _recordRoiOnly;
+    std::string _busName;
+    int _busCapacity;
+    int _metricsPort;
+    std::string _metricsFile;
+    std::string _traceFile;
+    int _traceEvents;
+    int _frameIdlePeriod;
+    int _frameHoldTime;
+    int _segmentLearnFrames;
+    std::string _flightDirectory;
+    int _flightSeconds;
+    int _flightPostSeconds;
+    int _flightRoiOnly;
+    std::vector<cv::Rect> _roiBoxes;
 };
 
 #endif /* CONFIG_H_ */
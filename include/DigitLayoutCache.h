@@ -0,0 +1,42 @@
+#ifndef INCLUDE_DIGITLAYOUTCACHE_H_
+#define INCLUDE_DIGITLAYOUTCACHE_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// Digit cells of one display field (kV, mA), learned from full segmentations.
+// The digits do not move relative to the ROI, so once the same cells were found on
+// learnFrames frames in a row they are cropped directly. An ink check per frame guards
+// the layout: every cell must hold a digit sized glyph and no new ink may appear outside
+// the cells. If it fails the caller segments the field again and re-learns.
+class DigitLayoutCache {
+public:
+	DigitLayoutCache(int learnFrames, int minHeight, int maxHeight);
+
+	// Boxes of the digits of the binary field: the learned cells cropped to the bounds of their ink.
+	// False if the layout is not learned yet or the check fails.
+	bool crop(const cv::Mat& field, std::vector<cv::Rect>& boxes);
+	// Learn from the digit boxes of a full segmentation of the field, sorted from left to right.
+	void learn(const cv::Mat& field, const std::vector<cv::Rect>& boxes);
+	void reset();
+
+	bool isLearned() const { return _learned; }
+	const std::vector<cv::Rect>& getCells() const { return _cells; }
+
+private:
+	bool matches(const std::vector<cv::Rect>& boxes) const;
+	static bool inkBounds(const cv::Mat& cell, cv::Rect& bounds, int& ink);
+
+	int _learnFrames;
+	int _minHeight;
+	int _maxHeight;
+
+	cv::Size _fieldSize;
+	std::vector<cv::Rect> _cells; // union of the digit boxes seen per position
+	int _frames;                  // consecutive frames that matched the cells
+	int _outsideInk;              // ink outside the cells, e.g. decimal points, while learning
+	int _minCellInk;              // least ink of a digit while learning
+	bool _learned;
+};
+
+#endif /* INCLUDE_DIGITLAYOUTCACHE_H_ */
@@ -0,0 +1,53 @@
+#ifndef INCLUDE_DIGITRECOGNIZER_H_
+#define INCLUDE_DIGITRECOGNIZER_H_
+
+#include <vector>
+#include <string>
+#include <opencv2/core/core.hpp>
+
+#include "GlyphBatch.h"
+
+// Common interface of the OCR engines.
+class DigitRecognizer {
+public:
+	virtual ~DigitRecognizer() {}
+
+	// Recognize a single digit, '?' if it can not be recognized.
+	// confidence, if given, receives a value between 0 (guess) and 1 (certain).
+	virtual char recognize(const cv::Mat& img, float* confidence = 0) = 0;
+
+	// Recognize a vector of digits.
+	virtual std::string recognize(const std::vector<cv::Mat>& images, std::vector<float>* confidences = 0) {
+		std::string result;
+		if (confidences) {
+			confidences->clear();
+		}
+		for (std::vector<cv::Mat>::const_iterator it = images.begin(); it != images.end(); ++it) {
+			float confidence = 0.f;
+			result += recognize(*it, &confidence);
+			if (confidences) {
+				confidences->push_back(confidence);
+			}
+		}
+		return result;
+	}
+
+	// Recognize the glyphs of a display field. Engines that classify the prepared
+	// samples override this, the default decodes the glyph views one by one.
+	virtual std::string recognize(const GlyphBatch& glyphs, std::vector<float>* confidences = 0) {
+		std::string result;
+		if (confidences) {
+			confidences->clear();
+		}
+		for (int i = 0; i < glyphs.size(); i++) {
+			float confidence = 0.f;
+			result += recognize(glyphs.glyph(i), &confidence);
+			if (confidences) {
+				confidences->push_back(confidence);
+			}
+		}
+		return result;
+	}
+};
+
+#endif /* INCLUDE_DIGITRECOGNIZER_H_ */
@@ -0,0 +1,120 @@
+#ifndef INCLUDE_ENGINE_H_
+#define INCLUDE_ENGINE_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <ctime>
+#include <opencv2/core/core.hpp>
+
+#include "Config.h"
+#include "ImageProcessor.h"
+#include "KNearestOcr.h"
+#include "DigitRecognizer.h"
+#include "ChannelValidator.h"
+#include "Metrics.h"
+
+// Recognition and validation result of one display channel.
+struct ChannelResult {
+	std::string digits;             // recognized characters, '?' where unknown
+	std::vector<float> confidence;  // per digit, 0 (guess) .. 1 (certain)
+	double value;                   // parsed digits, NaN if not a number
+	ChannelValidator::Status status;
+	Reading checked;                // last accepted reading, if hasChecked
+	bool hasChecked;
+};
+
+// Result of one frame.
+struct FrameResult {
+	time_t time;
+	bool powerOn;
+	ChannelResult kV;
+	ChannelResult mA;
+};
+
+// Embeddable recognition engine: image processing, OCR and validation of the kV and mA
+// displays of a frame. Load the model and the ROI layout once, then process frames.
+// Opens no windows; several engines can live in one process. The stage timers and the
+// validation counters go to the given metrics. The image processor, model and trace
+// instrumentation is process wide and shared by all engines.
+class Engine {
+public:
+	explicit Engine(const Config& config, Metrics& metrics = Metrics::instance());
+
+	// Load the OCR model and the ROI layout of the config. False if the KNN training data is missing.
+	bool load();
+	// Reload the KNN training data in the background whenever the file changes.
+	void watchModel(int intervalMs = 1000);
+
+	// ROI boxes: kV display, mA display, ..., power indicator last. False if less than 3.
+	bool setLayout(const std::vector<cv::Rect>& roiBoxes);
+	bool hasLayout() const;
+
+	FrameResult process(const cv::Mat& frame, time_t time);
+	// Process a frame with a processor of the caller, e.g. a DebugImageProcessor showing its steps.
+	template<class DebugView>
+	FrameResult process(BasicImageProcessor<DebugView>& proc, const cv::Mat& frame, time_t time);
+	// Frames are recognized in parallel and validated in order.
+	void process(const std::vector<cv::Mat>& frames, const std::vector<time_t>& times,
+			std::vector<FrameResult>& results);
+
+	bool usesKnn() const { return !_segmentOcr; }
+	const char* getEngineName() const { return usesKnn() ? "knn" : "segment"; }
+	KNearestOcr& getKnn() { return _knn; }
+	DigitRecognizer& getRecognizer() { return _segmentOcr ? *_segmentOcr : _knn; }
+	// Processor of the last single frame call, e.g. for its digit images.
+	ImageProcessor& getProcessor() { return _proc; }
+	ROIBox* getLayout() { return &_roi; }
+
+private:
+	template<class DebugView>
+	void recognize(BasicImageProcessor<DebugView>& proc, const cv::Mat& frame, FrameResult& result);
+	void checkLayout() const;
+	void validate(FrameResult& result);
+	void validate(ChannelValidator& validator, const ChannelRules& rules, time_t time, ChannelResult& result);
+
+	Config _config;
+	Metrics& _metrics;
+	ROIBox _roi;
+	ImageProcessor _proc;
+	KNearestOcr _knn;
+	std::unique_ptr<DigitRecognizer> _segmentOcr;
+	ChannelValidator _kVValidator;
+	ChannelValidator _mAValidator;
+};
+
+template<class DebugView>
+FrameResult Engine::process(BasicImageProcessor<DebugView>& proc, const cv::Mat& frame, time_t time) {
+	checkLayout();
+	FrameResult result;
+	result.time = time;
+	recognize(proc, frame, result);
+	validate(result);
+	return result;
+}
+
+template<class DebugView>
+void Engine::recognize(BasicImageProcessor<DebugView>& proc, const cv::Mat& frame, FrameResult& result) {
+	proc.ocrkVmA();
+	proc.debugPower();
+	// the processor only reads the frame unless a debug view draws on it
+	cv::Mat img = frame;
+	proc.setInput(img);
+	{
+		StageTimer timer(_metrics.process, "process");
+		proc.process(&_roi);
+	}
+	result.powerOn = proc.getpowerOn();
+
+	DigitRecognizer& recognizer = getRecognizer();
+	{
+		StageTimer timer(_metrics.recognize, "recognize kV");
+		result.kV.digits = recognizer.recognize(proc.getGlyphskV(), &result.kV.confidence);
+	}
+	{
+		StageTimer timer(_metrics.recognize, "recognize mA");
+		result.mA.digits = recognizer.recognize(proc.getGlyphsmA(), &result.mA.confidence);
+	}
+}
+
+#endif /* INCLUDE_ENGINE_H_ */
@@ -0,0 +1,85 @@
+#ifndef INCLUDE_FLIGHTRECORDER_H_
+#define INCLUDE_FLIGHTRECORDER_H_
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core/core.hpp>
+
+#include "Engine.h"
+
+// Keeps the last seconds of frames (or ROI crops) with their readings in a fixed ring and
+// writes them to disk only when something interesting happens, e.g. a rejected reading.
+// A trigger dumps the window once a few more frames were recorded. A trigger while a dump
+// is pending extends it to the frames after the new anomaly, as far as the ring keeps the
+// frames before the first one; beyond that it starts the next dump right after. The ring
+// and the dump buffer are allocated on the first frame and swapped on a dump, so memory
+// stays bounded and the capture thread never waits for the disk, except in stop().
+class FlightRecorder {
+public:
+	// Ring for seconds of frames at the given frame period, 0 seconds to disable.
+	FlightRecorder(const std::string& directory, int seconds, int postSeconds, int periodMs);
+	~FlightRecorder();
+
+	// Record only this part of the frames, empty = whole frame.
+	void setRoi(const cv::Rect& roi);
+
+	void start();
+	void stop();
+
+	// Keep the frame and its readings in place of the oldest one. Capture thread only.
+	void record(const cv::Mat& frame, uint64_t frameNo, const FrameResult& result);
+	// Dump the window around the last recorded frame. Capture thread only.
+	void trigger(const char* reason);
+
+	bool isEnabled() const { return !_slots.empty(); }
+	long getDumps();
+
+private:
+	struct Slot {
+		cv::Mat image;
+		uint64_t frame;
+		time_t time;
+		bool powerOn;
+		std::string kV;
+		std::string mA;
+		ChannelValidator::Status kVStatus;
+		ChannelValidator::Status mAStatus;
+	};
+
+	void snapshot(bool wait = false);
+	void run();
+	void writeDump();
+
+	std::string _directory;
+	int _seconds;
+	int _postFrames;
+	cv::Rect _roi;
+
+	// capture thread only
+	std::vector<Slot> _slots;
+	int _next;              // slot of the next frame
+	int _count;
+	int _pending;           // frames to record before the dump, -1 if no trigger is pending
+	int _sinceTrigger;      // frames recorded since the first trigger of the pending dump
+	std::string _reason;
+	std::string _nextReason; // trigger for a dump right after the pending one, empty if none
+
+	// dump handed to the writer thread, guarded by _mutex while not _dumpReady
+	std::vector<Slot> _dump;
+	int _dumpCount;
+	std::string _dumpReason;
+	time_t _dumpTime;
+	bool _dumpReady;
+	bool _running;
+	long _dumps;
+	std::mutex _mutex;
+	std::condition_variable _cond;
+	std::thread _thread;
+};
+
+#endif /* INCLUDE_FLIGHTRECORDER_H_ */
@@ -0,0 +1,37 @@
+#ifndef INCLUDE_FRAMESCHEDULER_H_
+#define INCLUDE_FRAMESCHEDULER_H_
+
+#include <chrono>
+
+// Issues frames at absolute deadlines, so the period does not drift with the processing time.
+// While the tube is powered or a display value changes, frames come at the active period;
+// after holdMs without activity the scheduler falls back to the idle period.
+// A frame that overruns its deadline is counted as missed and the schedule restarts
+// from now instead of catching up with a burst of frames.
+class FrameScheduler {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	FrameScheduler(int activeMs, int idleMs, int holdMs);
+
+	// Account the frame just processed and return the time left until the next deadline.
+	Clock::duration next(bool powerOn, bool changed);
+	// next() and sleep until the deadline.
+	void wait(bool powerOn, bool changed);
+
+	bool isActive() const { return _active; }
+	long getFrames() const { return _frames; }
+	long getMissed() const { return _missed; }
+
+private:
+	Clock::duration _activePeriod;
+	Clock::duration _idlePeriod;
+	Clock::duration _hold;
+	Clock::time_point _deadline;
+	Clock::time_point _lastActivity;
+	bool _active;
+	long _frames;
+	long _missed;
+};
+
+#endif /* INCLUDE_FRAMESCHEDULER_H_ */
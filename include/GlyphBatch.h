@@ -0,0 +1,42 @@
+#ifndef INCLUDE_GLYPHBATCH_H_
+#define INCLUDE_GLYPHBATCH_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// Glyphs of one display field: their boxes in the binary field and their classifier samples,
+// one float row of 10x10 pixels per glyph in a single preallocated buffer. assign() crops,
+// resizes and converts each glyph in one pass, without intermediate images, so a batch is
+// refilled every frame without allocations.
+class GlyphBatch {
+public:
+	static const int SAMPLE_SIZE = 10;
+	static const int SAMPLE_DIMS = SAMPLE_SIZE * SAMPLE_SIZE;
+
+	explicit GlyphBatch(int capacity = 16);
+
+	// Glyphs of the binary field at the given boxes, sorted from left to right.
+	void assign(const cv::Mat& field, const std::vector<cv::Rect>& boxes);
+	void clear();
+
+	int size() const { return _count; }
+	bool empty() const { return _count == 0; }
+	const cv::Rect& box(int i) const { return _boxes[i]; }
+	// View of a glyph in the field, e.g. for the seven segment decoder or learning.
+	cv::Mat glyph(int i) const { return _field(_boxes[i]); }
+	const float* sample(int i) const { return _samples.ptr<float>(i); }
+	// Samples of all glyphs, one row each.
+	cv::Mat samples() const { return _samples.rowRange(0, _count); }
+
+	// Resize an 8 bit glyph to 10x10 like cv::resize with INTER_LINEAR and store it as
+	// whole gray levels in a float row of SAMPLE_DIMS values.
+	static void prepare(const cv::Mat& glyph, float* sample);
+
+private:
+	cv::Mat _field;
+	std::vector<cv::Rect> _boxes;
+	cv::Mat _samples; // capacity rows, the first _count are valid
+	int _count;
+};
+
+#endif /* INCLUDE_GLYPHBATCH_H_ */
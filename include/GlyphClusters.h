@@ -0,0 +1,50 @@
+#ifndef INCLUDE_GLYPHCLUSTERS_H_
+#define INCLUDE_GLYPHCLUSTERS_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "Config.h"
+#include "ImageProcessor.h"
+
+// Glyphs of the kV and mA displays collected from many frames and clustered by the squared
+// distance of their samples, the distance the KNN classifier uses. An operator labels each
+// cluster of near identical glyphs once instead of every glyph.
+class GlyphClusters {
+public:
+	struct Cluster {
+		std::vector<int> members; // glyph indices, nearest to the center first
+		float spread;             // squared distance of the farthest member to the center
+	};
+
+	GlyphClusters(const Config& config, int maxGlyphs = 20000);
+
+	// Segment the frames in parallel and collect their glyphs. False once maxGlyphs are collected.
+	bool extract(const std::vector<cv::Mat>& frames, ROIBox* roi);
+
+	// Cluster all glyphs into at most k clusters, largest first.
+	void cluster(int k);
+	// Split a cluster into at most k smaller ones, largest first.
+	std::vector<Cluster> split(const Cluster& cluster, int k) const;
+
+	int getGlyphCount() const { return _samples.rows; }
+	const std::vector<Cluster>& getClusters() const { return _clusters; }
+	const cv::Mat& getImage(int glyph) const { return _images[glyph]; }
+	// Samples of up to maxSamples members, spread evenly from the nearest to the farthest.
+	cv::Mat getSamples(const Cluster& cluster, int maxSamples) const;
+
+	// Tiles of the members nearest to the center, the representative first, and a last row
+	// of the farthest members framed in gray, so outliers stand out.
+	cv::Mat montage(const Cluster& cluster, int maxTiles = 40) const;
+
+private:
+	std::vector<Cluster> kmeans(const std::vector<int>& glyphs, int k) const;
+
+	Config _config;
+	int _maxGlyphs;
+	cv::Mat _samples;             // one prepared sample per glyph
+	std::vector<cv::Mat> _images; // binary glyph crops
+	std::vector<Cluster> _clusters;
+};
+
+#endif /* INCLUDE_GLYPHCLUSTERS_H_ */
@@ -1,8 +1,11 @@
 #ifndef INCLUDE_IMAGEINPUT_H_
 #define INCLUDE_IMAGEINPUT_H_
 
+#include <vector>
+#include <cstdint>
 #include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
 
 #include "Directory.h"
 
@@ -17,6 +20,8 @@ public:
 	virtual time_t getTime();
 	virtual void setOutputDir(const std::string& outDir);
 	virtual void saveImage();
+	// ROI layout known from the source of the frames, empty if unknown.
+	virtual std::vector<cv::Rect> getLayout() const;
 
 protected:
 	cv::Mat _img;
@@ -47,5 +52,85 @@ public:
 private:
 	cv::VideoCapture _capture;
 };
+////
+
+class VideoInput: public ImageInput {
+public:
+	VideoInput(const std::string& filename);
+
+	virtual bool nextImage();
+
+private:
+	cv::VideoCapture _capture;
+	time_t _startTime;
+};
+////
+
+// Frames of 8 bit luma: GREY, or the Y samples of YUYV. GREY frames are handed out as a
+// view of the source buffer without a copy, valid until the next call of nextImage().
+class LumaInput: public ImageInput {
+protected:
+	bool setFrame(const uchar* data, int width, int height, int stride, uint32_t fourcc);
+
+private:
+	cv::Mat _luma; // Y plane extracted from YUYV, reused
+};
+////
+
+// Native V4L2 capture into memory mapped driver buffers. Negotiates GREY, then YUYV, so
+// the pipeline gets the luma plane without decoding and color conversion.
+class V4l2Input: public LumaInput {
+public:
+	V4l2Input(const std::string& device, int width = 0, int height = 0);
+	virtual ~V4l2Input();
+
+	virtual bool nextImage();
+	bool isOpened() const { return _streaming; }
+
+private:
+	struct Buffer {
+		void* start;
+		size_t length;
+	};
+
+	bool open(int width, int height);
+	bool negotiate(uint32_t fourcc, int width, int height);
+	void close();
+	void requeue(int index);
+
+	std::string _device;
+	int _fd;
+	std::vector<Buffer> _buffers;
+	int _held; // buffer handed out as the current image, -1 if none
+	uint32_t _fourcc;
+	int _width;
+	int _height;
+	int _stride;
+	bool _streaming;
+};
+////
+
+// Stand-in for a capture device: a file of raw GREY or YUYV frames (e.g. written by
+// ffmpeg -f rawvideo), memory mapped and handed out like driver buffers.
+class RawFileInput: public LumaInput {
+public:
+	RawFileInput(const std::string& filename, int width, int height, uint32_t fourcc);
+	virtual ~RawFileInput();
+
+	virtual bool nextImage();
+
+private:
+	std::string _filename;
+	const uchar* _data;
+	size_t _size;
+	size_t _next;
+	int _width;
+	int _height;
+	uint32_t _fourcc;
+};
+
+// Input for -d: a V4L2 device, or "<file>:<width>x<height>" for a raw frame file,
+// YUYV if the file name ends in .yuyv, GREY otherwise. Null if the spec is invalid.
+ImageInput* createLumaInput(const std::string& spec);
 
 #endif
@@ -8,27 +8,54 @@
 
 #include "ImageInput.h"
 #include "Config.h"
+#include "Log.h"
+#include "DigitLayoutCache.h"
+#include "GlyphBatch.h"
 
 
 class ROIBox
 {
 public:
 	ROIBox() : roiBox(0) { }
-	std::vector<cv::Rect> getROIBox() { return roiBox; }
-	void setROIBox(std::vector<cv::Rect>& _roiBox) { roiBox = _roiBox; std::cout << "ROI box #: " << roiBox.size() << std::endl; }
+	std::vector<cv::Rect> getROIBox() const { return roiBox; }
+	void setROIBox(std::vector<cv::Rect>& _roiBox) { roiBox = _roiBox; LOG_INFO("ROI box #: " << roiBox.size()); }
 private:
 	std::vector<cv::Rect> roiBox;
 };
 
-class ImageProcessor {
+// Debug visualization policies of the image processor. The debug branches test
+// DebugView::enabled, so with NoDebugView they and their drawing are compiled out.
+struct NoDebugView {
+	static constexpr bool enabled = false;
+	static void open(const char*) { }
+	static void show(const char*, const cv::Mat&) { }
+	static int waitKey(int) { return 0; }
+};
+
+#ifndef KNNOCR_NO_HIGHGUI
+// Shows the debug images in HighGUI windows.
+struct WindowDebugView {
+	static constexpr bool enabled = true;
+	static void open(const char* name);
+	static void show(const char* name, const cv::Mat& img);
+	static int waitKey(int delayMs);
+};
+#endif
+
+template<class DebugView>
+class BasicImageProcessor {
 public:
-	ImageProcessor(const Config& config);
+	BasicImageProcessor(const Config& config);
 
 	void setOrientation(int rotationDegrees);
 	void setInput(cv::Mat& img);
 	void process();
 	bool process(ROIBox* roi);
 	const std::vector<cv::Mat>& getOutput();
+	// Glyphs of the kV and mA displays, ready for the classifier.
+	const GlyphBatch& getGlyphskV() const { return _kVGlyphs; }
+	const GlyphBatch& getGlyphsmA() const { return _mAGlyphs; }
+	// Views of the glyphs, e.g. for learning.
 	const std::vector<cv::Mat>& getOutputkV();
 	const std::vector<cv::Mat>& getOutputmA();
 
@@ -47,6 +74,8 @@ public:
 	bool getpowerOn() { return powerOn; }
 
 private:
+	friend struct KernelAccess; // microbenchmarks of the private kernels, bench/kernels.cpp
+
 	void rotate(double rotationDegrees);
 	void findCounterDigits();
 	void findCounterDigits(ROIBox* roi);
@@ -59,14 +88,18 @@ private:
 	cv::Mat binaryFiltering();
 	void filterContours(std::vector<std::vector<cv::Point>>& contours, std::vector<cv::Rect>& boundingBoxes,
 			std::vector<std::vector<cv::Point>>& filteredContours);
+	void segmentField(const cv::Mat& field, DigitLayoutCache& layout, GlyphBatch& glyphs);
 
 
 	cv::Mat _img;
 	cv::Mat _imgGray;
 	cv::Mat _imgBin;
 	std::vector<cv::Mat> _digits;
-	std::vector<cv::Mat> _digits_kV;
+	std::vector<cv::Mat> _digits_kV; // views of the glyphs, filled on request
 	std::vector<cv::Mat> _digits_mA;
+	GlyphBatch _kVGlyphs;
+	GlyphBatch _mAGlyphs;
+	std::vector<cv::Rect> _glyphBoxes;
 	Config _config;
 	bool _debugWindow;
 	bool _debugSkew;
@@ -79,7 +112,17 @@ private:
 
 	int _key;
 
-	std::ofstream ofs;
+	DigitLayoutCache _kVLayout;
+	DigitLayoutCache _mALayout;
 };
 
+// Production processor, no debug visualization.
+typedef BasicImageProcessor<NoDebugView> ImageProcessor;
+#ifndef KNNOCR_NO_HIGHGUI
+typedef BasicImageProcessor<WindowDebugView> DebugImageProcessor;
+#else
+// without HighGUI the debug settings have no effect
+typedef BasicImageProcessor<NoDebugView> DebugImageProcessor;
+#endif
+
 #endif /* INCLUDE_IMAGEPROCESSOR_H_ */
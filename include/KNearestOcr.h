@@ -4,36 +4,88 @@
 #include <vector>
 #include <list>
 #include <string>
+#include <fstream>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <sys/stat.h>
 #include "opencv2/core/version.hpp"
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/ml/ml.hpp>
 
 #include "Config.h"
+#include "DigitRecognizer.h"
+#include "TrainingSet.h"
 
-class KNearestOcr {
+class KNearestOcr: public DigitRecognizer {
 public:
+	struct Neighbor {
+		float dist;
+		float response;
+		int index;
+	};
+
 	KNearestOcr(const Config& config);
 	virtual ~KNearestOcr();
 
-	int learn(const cv::Mat& img);
-	int learn(const std::vector<cv::Mat>& images);
+	int learn(const TrainingSet& trainingSet, bool merge = false);
+	int addSample(const cv::Mat& img, char label);
+	int addSamples(const cv::Mat& samples, char label);
+	bool removeSample(int index);
+	int removeNearest(const cv::Mat& img);
+	int getSampleCount() const;
+	cv::Mat getSamples() const;
+	cv::Mat getResponses() const;
 	bool hasTrainingData();
 	void saveTrainingData();
 	bool loadTrainingData();
+	void watchTrainingData(int intervalMs = 1000);
+
+	using DigitRecognizer::recognize;
+	virtual char recognize(const cv::Mat& img, float* confidence = 0);
+	virtual std::string recognize(const GlyphBatch& glyphs, std::vector<float>* confidences = 0);
 
-	char recognize(const cv::Mat& img);
-	std::string recognize(const std::vector<cv::Mat>& images);
+	static int findNearest(const cv::Mat& samples, const cv::Mat& responses, const float* sample,
+			int k, float maxDist, Neighbor* neighbors);
+	static char vote(const Neighbor* neighbors, int found);
 
 private:
+	friend struct KernelAccess; // microbenchmarks of the private kernels, bench/kernels.cpp
+
+	// Snapshot of the training data. Samples are only ever appended behind count, so
+	// rows a reader has seen never change; everything else publishes a new snapshot.
+	struct Model {
+		Model(int capacity);
+		cv::Mat samples;   // preallocated store, only the first count rows are valid
+		cv::Mat responses;
+		std::atomic<int> count;
+	};
+
 	cv::Mat prepareSample(const cv::Mat& img);
-	void initModel();
+	char classify(const Model& model, int count, const float* sample, float* confidence);
+	std::shared_ptr<Model> currentModel() const;
+	void publishModel(const std::shared_ptr<Model>& model);
+	static std::shared_ptr<Model> loadModel(const std::string& filename);
+	static std::shared_ptr<Model> copyModel(const Model& model, int capacity, int skip = -1);
+	int appendSamples(const cv::Mat& samples, const cv::Mat& responses, bool replace = false);
+	void watch(int intervalMs);
 
-	cv::Mat _samples;
-	cv::Mat _responses;
-	cv::Ptr<cv::ml::KNearest> _pModel;
+	std::shared_ptr<Model> _model;      // guarded by _modelMutex
+	uint64_t _modelGeneration;          // generation of _model, guarded by _modelMutex
+	std::atomic<uint64_t> _generation;  // generation of _model, read without the lock
+	mutable std::mutex _modelMutex;
+	std::mutex _writeMutex;
 	Config _config;
 
-	std::ofstream ofs;
+	std::thread _watcher;
+	std::mutex _watchMutex;
+	std::condition_variable _watchCond;
+	bool _watching;
+	struct stat _seen;   // the training data file as last seen or written by this process
+	bool _reloadPending; // _seen changed, reload once it stays the same
+	uint64_t _saves;     // saves so far, a reload started before a save is dropped
 };
 
 #endif /* INCLUDE_KNEARESTOCR_H_ */
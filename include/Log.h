@@ -0,0 +1,114 @@
+#ifndef INCLUDE_LOG_H_
+#define INCLUDE_LOG_H_
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <ctime>
+#include <cstdint>
+
+// Asynchronous leveled logger.
+// Messages are copied into a bounded ring of fixed size entries and written by a
+// background thread in batches, so the frame loop never waits for the console.
+// If the writer falls behind, new messages are dropped and the loss is reported.
+class Logger {
+public:
+	enum Level { DEBUG, INFO, WARN, ERROR, OFF };
+
+	static Logger& instance();
+
+	void setLevel(Level level) { _level.store(level, std::memory_order_relaxed); }
+	Level getLevel() const { return (Level) _level.load(std::memory_order_relaxed); }
+	bool enabled(Level level) const { return level >= _level.load(std::memory_order_relaxed); }
+
+	void write(Level level, const std::string& message);
+	void flush();
+	void close();
+
+	long getDropped() const { return _dropped.load(); }
+
+	static bool parseLevel(const std::string& name, Level& level);
+	static const char* levelName(Level level);
+
+private:
+	static const int CAPACITY = 1024;
+	static const int MAX_MESSAGE = 496;
+
+	struct Entry {
+		Level level;
+		struct timespec time;
+		int length;
+		char text[MAX_MESSAGE];
+	};
+
+	Logger();
+	void run();
+	void print(const Entry& entry);
+
+	std::atomic<int> _level;
+	std::vector<Entry> _ring;
+	std::vector<Entry> _batch;
+	int _head;
+	int _count;
+	bool _busy;
+	bool _running;
+	std::atomic<long> _dropped;
+	long _reportedDropped;
+	std::mutex _mutex;
+	std::condition_variable _ready;
+	std::condition_variable _drained;
+};
+
+// Lets a message through at most once per interval and counts the ones held back.
+class LogRateLimiter {
+public:
+	explicit LogRateLimiter(int intervalMs) : _intervalNs(int64_t(intervalMs) * 1000000), _next(0), _suppressed(0) { }
+
+	// True if the message may be logged, suppressed is the number skipped since the last one.
+	bool allow(long& suppressed);
+
+private:
+	int64_t _intervalNs;
+	std::atomic<int64_t> _next;
+	std::atomic<long> _suppressed;
+};
+
+#define LOG_AT(level, msg) \
+	do { \
+		if (Logger::instance().enabled(level)) { \
+			std::ostringstream _logStream; \
+			_logStream << msg; \
+			Logger::instance().write(level, _logStream.str()); \
+		} \
+	} while (0)
+
+// Log at most once every intervalMs from this call site.
+#define LOG_EVERY(level, intervalMs, msg) \
+	do { \
+		if (Logger::instance().enabled(level)) { \
+			static LogRateLimiter _logLimiter(intervalMs); \
+			long _logSuppressed; \
+			if (_logLimiter.allow(_logSuppressed)) { \
+				std::ostringstream _logStream; \
+				_logStream << msg; \
+				if (_logSuppressed > 0) _logStream << " (" << _logSuppressed << " similar messages suppressed)"; \
+				Logger::instance().write(level, _logStream.str()); \
+			} \
+		} \
+	} while (0)
+
+// Debug logs are compiled out with -DKNNOCR_NO_DEBUG_LOG, the message is not even evaluated.
+#ifdef KNNOCR_NO_DEBUG_LOG
+#define LOG_DEBUG(msg) do { } while (0)
+#else
+#define LOG_DEBUG(msg) LOG_AT(Logger::DEBUG, msg)
+#endif
+#define LOG_INFO(msg) LOG_AT(Logger::INFO, msg)
+#define LOG_WARN(msg) LOG_AT(Logger::WARN, msg)
+#define LOG_ERROR(msg) LOG_AT(Logger::ERROR, msg)
+#define LOG_WARN_EVERY(intervalMs, msg) LOG_EVERY(Logger::WARN, intervalMs, msg)
+
+#endif /* INCLUDE_LOG_H_ */
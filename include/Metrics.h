@@ -0,0 +1,151 @@
+#ifndef INCLUDE_METRICS_H_
+#define INCLUDE_METRICS_H_
+
+#include <string>
+#include <ostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <cstdint>
+
+#include "Trace.h"
+
+// Monotonic counter. Increments are relaxed atomics, safe from any thread.
+class Counter {
+public:
+	Counter() : _value(0) { }
+	void inc(uint64_t n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+	uint64_t get() const { return _value.load(std::memory_order_relaxed); }
+private:
+	std::atomic<uint64_t> _value;
+};
+
+// Value that can go up and down.
+class Gauge {
+public:
+	Gauge() : _value(0) { }
+	void set(int64_t value) { _value.store(value, std::memory_order_relaxed); }
+	int64_t get() const { return _value.load(std::memory_order_relaxed); }
+private:
+	std::atomic<int64_t> _value;
+};
+
+// Latency histogram with power of two buckets from 1 us to about 1 s.
+// Observing a value is a handful of relaxed atomic adds, no locks.
+class Histogram {
+public:
+	static const int BUCKETS = 21;
+
+	Histogram();
+	void observe(uint64_t micros);
+	void write(std::ostream& os, const std::string& name, const std::string& help) const;
+
+	// Sum of the observed values, e.g. to time one call through its stage timers.
+	uint64_t getSum() const { return _sum.load(std::memory_order_relaxed); }
+
+	static uint64_t upperBound(int bucket) { return uint64_t(1) << bucket; }
+
+private:
+	std::atomic<uint64_t> _buckets[BUCKETS + 1]; // last one is +Inf
+	std::atomic<uint64_t> _sum;
+	std::atomic<uint64_t> _count;
+};
+
+// Records the lifetime of a scope into a histogram, and as a trace span if a span name is given.
+class StageTimer {
+public:
+	explicit StageTimer(Histogram& histogram, const char* span = nullptr) :
+			_histogram(histogram), _span(span), _start(std::chrono::steady_clock::now()) { }
+	~StageTimer() {
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		_histogram.observe(std::chrono::duration_cast<std::chrono::microseconds>(end - _start).count());
+		if (_span && Tracer::enabled()) {
+			Tracer::instance().record(_span, _start, end);
+		}
+	}
+private:
+	Histogram& _histogram;
+	const char* _span;
+	std::chrono::steady_clock::time_point _start;
+};
+
+// Instrumentation of the frame loop. instance() holds the process wide metrics, the ones
+// exported; an engine can be given a set of its own instead.
+class Metrics {
+public:
+	Metrics() : _channels(0) { }
+
+	static const int MAX_CHANNELS = 4;
+	static const int STATUSES = 6; // ChannelValidator::Status
+
+	Histogram capture;
+	Histogram process;
+	Histogram segment;
+	Histogram recognize;
+	Histogram validate;
+
+	Counter framesCaptured;
+	Counter captureFailures;
+	Counter recorderDropped;
+	Counter busPublished;
+	Counter deadlinesMissed;
+	Counter segmentCacheHits;
+	Counter segmentCheckFailures;
+	Counter flightDumps;
+	Gauge framePeriod;
+
+	Gauge modelSamples;
+	Counter modelReloads;
+	Counter modelReloadFailures;
+
+	// Per channel validation outcome counters, indexed by ChannelValidator::Status.
+	Counter* validationCounters(const std::string& channel);
+
+	void write(std::ostream& os) const;
+	bool dump(const std::string& filename) const;
+
+	static Metrics& instance();
+
+private:
+	Metrics(const Metrics&) = delete;
+	Metrics& operator=(const Metrics&) = delete;
+
+	std::string _channelNames[MAX_CHANNELS];
+	Counter _validations[MAX_CHANNELS][STATUSES];
+	std::atomic<int> _channels;
+	std::mutex _channelMutex;
+};
+
+// Exports the metrics in Prometheus text format on a local HTTP port and
+// dumps them to a file on SIGUSR1. Runs on its own thread.
+// With a trace file, SIGUSR2 starts tracing and the next SIGUSR2 stops it and writes the
+// trace; GET /trace returns the spans recorded so far.
+class MetricsExporter {
+public:
+	MetricsExporter(int port, const std::string& dumpFile);
+	~MetricsExporter();
+
+	// Trace into a ring of traceEvents spans, 0 to disable tracing.
+	void setTrace(const std::string& traceFile, int traceEvents);
+
+	void start();
+	void stop();
+
+private:
+	void run();
+	bool listenOn(int port);
+	void serve(int client);
+
+	void toggleTrace();
+
+	int _port;
+	std::string _dumpFile;
+	std::string _traceFile;
+	int _traceEvents;
+	int _socket;
+	std::atomic<bool> _running;
+	std::thread _thread;
+};
+
+#endif /* INCLUDE_METRICS_H_ */
@@ -0,0 +1,43 @@
+#ifndef INCLUDE_MODELEVALUATOR_H_
+#define INCLUDE_MODELEVALUATOR_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "Config.h"
+
+// Cross validation of OCR training data: accuracy, confusion, nearest neighbor
+// distances and throughput of the available KNN backends.
+class ModelEvaluator {
+public:
+	enum Backend { NATIVE, CV_BRUTE_FORCE, CV_KDTREE };
+
+	ModelEvaluator(const Config& config, const cv::Mat& samples, const cv::Mat& responses);
+
+	void evaluate(int folds);
+
+private:
+	struct Result {
+		std::vector<char> predicted;
+		std::vector<float> nearestDist;
+		double seconds;
+	};
+
+	void classify(Backend backend, int k, int folds, float maxDist, Result& result);
+	void classifyNative(const cv::Mat& trainSamples, const cv::Mat& trainResponses, const std::vector<int>& test,
+			bool excludeSelf, int k, float maxDist, Result& result);
+	void classifyOpenCV(Backend backend, const cv::Mat& trainSamples, const cv::Mat& trainResponses,
+			const std::vector<int>& test, bool excludeSelf, int k, Result& result);
+	void printConfusion(const Result& result);
+	void printDistances(const Result& result);
+
+	char label(int i) const;
+	static int classIndex(char c);
+	static const char* backendName(Backend backend);
+
+	Config _config;
+	cv::Mat _samples;
+	cv::Mat _responses;
+};
+
+#endif /* INCLUDE_MODELEVALUATOR_H_ */
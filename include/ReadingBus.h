@@ -0,0 +1,81 @@
+#ifndef INCLUDE_READINGBUS_H_
+#define INCLUDE_READINGBUS_H_
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+// Readings of one frame as published on the bus.
+struct BusRecord {
+	static const int MAX_DIGITS = 8;
+
+	int64_t timeNs;    // CLOCK_REALTIME of publication
+	uint64_t frame;    // frames processed before this one in the producer's run
+	float kV;          // NaN if the digits could not be parsed
+	float mA;
+	uint8_t powerOn;
+	uint8_t kVChecked; // value passed the channel validator
+	uint8_t mAChecked;
+	uint8_t reserved;
+	char kVDigits[MAX_DIGITS]; // recognized characters, 0 terminated if shorter
+	char mADigits[MAX_DIGITS];
+	float kVConfidence[MAX_DIGITS];
+	float mAConfidence[MAX_DIGITS];
+};
+
+// Fixed-size ring of BusRecords in POSIX shared memory.
+// There is one producer; any number of readers follow it without locks. Each slot has a
+// sequence number that is odd while the producer writes it (seqlock), so a reader detects
+// torn or overwritten records and never blocks the producer.
+// A restarted producer replaces the segment instead of resizing and clearing the one readers
+// still have mapped; readers notice the new segment and attach to it.
+class ReadingBus {
+public:
+	ReadingBus(const std::string& name, int capacity = 1024);
+	~ReadingBus();
+
+	bool open();
+	void publish(const BusRecord& record);
+
+private:
+	struct Header;
+	friend class ReadingBusReader;
+
+	std::string _name;
+	int _capacity;
+	size_t _size;
+	Header* _header;
+};
+
+// Reader side of the bus, for local consumers.
+class ReadingBusReader {
+public:
+	ReadingBusReader(const std::string& name);
+	~ReadingBusReader();
+
+	bool open();
+	// Copy the next record. Returns false if there is no new record yet.
+	// While idle it checks once a second whether the producer replaced the bus.
+	bool next(BusRecord& record);
+	// Skip everything published so far.
+	void seekToEnd();
+	// Records overwritten before they could be read.
+	uint64_t getLost() const { return _lost; }
+
+private:
+	bool replaced();
+	void close();
+
+	std::string _name;
+	size_t _size;
+	const ReadingBus::Header* _header;
+	dev_t _dev; // identity of the mapped segment
+	ino_t _ino;
+	int64_t _checkedNs; // last check for a replaced segment
+	uint64_t _next;
+	uint64_t _lost;
+};
+
+#endif /* INCLUDE_READINGBUS_H_ */
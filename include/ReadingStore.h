@@ -0,0 +1,83 @@
+#ifndef INCLUDE_READINGSTORE_H_
+#define INCLUDE_READINGSTORE_H_
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <ctime>
+#include <cstdint>
+
+#include "ChannelValidator.h"
+
+// Append-only store of validated readings with per-minute rollups.
+// <directory>/raw.dat holds fixed-size records of value changes (plus one record per
+// minute while a value is unchanged), <directory>/1m.dat min/max/mean of every minute.
+// Both files are sorted by time, so range queries are binary searches.
+class ReadingStore {
+public:
+	enum Channel { KV = 0, MA = 1, NUM_CHANNELS };
+	enum FsyncPolicy { FSYNC_NEVER, FSYNC_BATCH, FSYNC_INTERVAL };
+
+	struct Record {
+		int64_t time;
+		float value;
+		uint8_t channel;
+		uint8_t reserved[3];
+	};
+
+	struct Rollup {
+		int64_t time; // start of the minute
+		uint8_t channel;
+		uint8_t reserved[3];
+		uint32_t count;
+		float min;
+		float max;
+		float mean;
+		uint32_t reserved2;
+	};
+
+	ReadingStore(const std::string& directory, int batchSize = 64, FsyncPolicy policy = FSYNC_BATCH,
+			int fsyncInterval = 60);
+	~ReadingStore();
+
+	bool open();
+	void append(Channel channel, const Reading& reading);
+	void flush();
+
+	bool query(Channel channel, time_t from, time_t to, const std::function<void(const Record&)>& callback) const;
+	bool queryRollups(Channel channel, time_t from, time_t to, const std::function<void(const Rollup&)>& callback) const;
+
+	static FsyncPolicy parseFsyncPolicy(const std::string& policy);
+	static const char* channelName(int channel);
+
+private:
+	struct Aggregate {
+		int64_t minute;
+		uint32_t count;
+		float min;
+		float max;
+		double sum;
+	};
+
+	void closeRollup(Channel channel);
+	bool writeAll(int fd, const void* data, size_t size);
+	template<class T> bool scan(const std::string& filename, Channel channel, time_t from, time_t to,
+			const std::function<void(const T&)>& callback) const;
+
+	std::string _directory;
+	int _batchSize;
+	FsyncPolicy _policy;
+	int _fsyncInterval;
+
+	int _rawFd;
+	int _rollupFd;
+	std::vector<Record> _records;
+	std::vector<Rollup> _rollups;
+	time_t _lastSync;
+
+	Record _last[NUM_CHANNELS];
+	bool _hasLast[NUM_CHANNELS];
+	Aggregate _aggregate[NUM_CHANNELS];
+};
+
+#endif /* INCLUDE_READINGSTORE_H_ */
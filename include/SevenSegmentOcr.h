@@ -0,0 +1,115 @@
+#ifndef INCLUDE_SEVENSEGMENTOCR_H_
+#define INCLUDE_SEVENSEGMENTOCR_H_
+
+#include <algorithm>
+#include <opencv2/core/core.hpp>
+
+#include "Config.h"
+#include "DigitRecognizer.h"
+
+// Sampling geometry of a seven segment digit, relative to the bounding box of the digit.
+// Segments are a (top), b (upper right), c (lower right), d (bottom), e (lower left),
+// f (upper left), g (middle); the last point is the decimal point, sampled in dot sized boxes.
+// Add a struct with the same members for displays with a different font.
+struct StandardSegmentGeometry {
+	static constexpr float x[8] = { .50f, .84f, .84f, .50f, .16f, .16f, .50f, .50f };
+	static constexpr float y[8] = { .08f, .28f, .72f, .92f, .72f, .28f, .50f, .50f };
+	static constexpr float radius = .06f;      // half size of the sampled window
+	static constexpr float oneMaxAspect = .4f; // narrower boxes (width/height) only hold segments b and c
+	static constexpr float dotMinAspect = .7f; // wider boxes are decimal points
+};
+
+// Slanted digits as found on most VFD and LCD consoles (about 8 deg).
+struct ItalicSegmentGeometry {
+	static constexpr float x[8] = { .56f, .88f, .80f, .44f, .12f, .20f, .50f, .50f };
+	static constexpr float y[8] = { .08f, .28f, .72f, .92f, .72f, .28f, .50f, .50f };
+	static constexpr float radius = .06f;
+	static constexpr float oneMaxAspect = .45f;
+	static constexpr float dotMinAspect = .7f;
+};
+
+// Decodes binary seven segment digits by sampling the segment positions and looking the
+// resulting bit pattern up in a table. Needs no training data.
+template<class Geometry>
+class SevenSegmentOcr: public DigitRecognizer {
+public:
+	SevenSegmentOcr() {
+	}
+
+	using DigitRecognizer::recognize;
+
+	virtual char recognize(const cv::Mat& img, float* confidence = 0) {
+		char c = decode(img);
+		if (confidence) {
+			*confidence = (c == '?') ? 0.f : 1.f;
+		}
+		return c;
+	}
+
+private:
+	static char decode(const cv::Mat& img) {
+		if (img.empty()) {
+			return '?';
+		}
+		float aspect = (float) img.cols / img.rows;
+		if (aspect >= Geometry::dotMinAspect) {
+			return lit(img, Geometry::x[7], Geometry::y[7]) ? '.' : '?';
+		}
+
+		int pattern = 0;
+		if (aspect < Geometry::oneMaxAspect) {
+			// the box only spans the right segments, sample them in its center
+			pattern |= lit(img, .5f, Geometry::y[1]) << 1;
+			pattern |= lit(img, .5f, Geometry::y[2]) << 2;
+		} else {
+			for (int s = 0; s < 7; s++) {
+				pattern |= lit(img, Geometry::x[s], Geometry::y[s]) << s;
+			}
+		}
+		return table()[pattern];
+	}
+
+	// A segment is lit if at least half of the sampled window is set.
+	static int lit(const cv::Mat& img, float x, float y) {
+		int cx = (int) (x * img.cols);
+		int cy = (int) (y * img.rows);
+		int r = std::max(0, (int) (Geometry::radius * img.rows));
+		int x0 = std::max(0, cx - r), x1 = std::min(img.cols - 1, cx + r);
+		int y0 = std::max(0, cy - r), y1 = std::min(img.rows - 1, cy + r);
+		int set = 0;
+		for (int j = y0; j <= y1; j++) {
+			const uchar* row = img.ptr<uchar>(j);
+			for (int i = x0; i <= x1; i++) {
+				set += row[i] > 127;
+			}
+		}
+		return 2 * set >= (x1 - x0 + 1) * (y1 - y0 + 1);
+	}
+
+	// 128 entry table from segment bits (a = bit 0 .. g = bit 6) to character.
+	static const char* table() {
+		struct Table {
+			char c[128];
+			Table() {
+				for (int i = 0; i < 128; i++) c[i] = '?';
+				c[0x3F] = '0';
+				c[0x06] = '1';
+				c[0x5B] = '2';
+				c[0x4F] = '3';
+				c[0x66] = '4';
+				c[0x6D] = '5';
+				c[0x7D] = '6'; c[0x7C] = '6';
+				c[0x07] = '7'; c[0x27] = '7';
+				c[0x7F] = '8';
+				c[0x6F] = '9'; c[0x67] = '9';
+			}
+		};
+		static const Table t;
+		return t.c;
+	}
+};
+
+// Seven segment engine selected by ocrEngine and segmentGeometry in the config, or null for KNN.
+DigitRecognizer* createSevenSegmentOcr(const Config& config);
+
+#endif /* INCLUDE_SEVENSEGMENTOCR_H_ */
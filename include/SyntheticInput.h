@@ -0,0 +1,79 @@
+#ifndef INCLUDE_SYNTHETICINPUT_H_
+#define INCLUDE_SYNTHETICINPUT_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <opencv2/core/core.hpp>
+
+#include "ImageInput.h"
+#include "Config.h"
+
+// Parameters of the synthetic display, set with key=value pairs of the -S spec.
+struct SyntheticOptions {
+	int width = 640;
+	int height = 480;
+	double fps = 25.;        // frame rate of the frame times
+	int frames = 0;          // frames to produce, 0 for endless
+	double noise = 0.;       // sigma of gaussian pixel noise
+	int blur = 0;            // gaussian blur kernel size, 0 for none
+	double drift = 0.;       // amplitude of the brightness drift
+	int driftFrames = 250;   // period of the brightness drift
+	double rotate = 0.;      // amplitude of the rotation drift in degrees
+	int changeFrames = 25;   // frames between value changes, 0 for constant values
+	int powerFrames = 0;     // period of the power indicator, on for the first half, 0 for always on
+	double kVMin = 40.;
+	double kVMax = 125.;
+	double mAMin = 0.5;
+	double mAMax = 99.9;
+	unsigned seed = 1;
+	bool gray = false;       // 8 bit luma frames instead of BGR
+	std::string truthFile;   // CSV of the ground truth per frame, none if empty
+
+	// Parse "key=value,key=value", e.g. "fps=100,noise=6,truth=truth.csv". False on unknown keys.
+	bool parse(const std::string& spec);
+};
+
+// Values shown on the frame last produced.
+struct SyntheticTruth {
+	long frame;
+	time_t time;
+	bool powerOn;
+	std::string kV;   // as displayed, e.g. "120", "25.5"
+	std::string mA;
+	double kVValue;
+	double mAValue;
+};
+
+// Renders kV and mA seven segment displays and a power indicator with known values, for load
+// testing and accuracy checks without a camera. Digits are drawn into the ROI layout of the
+// config, or into a layout of its own that getLayout() reports. Noise, blur, brightness and
+// rotation drift make the frames less ideal; the values follow a random schedule.
+class SyntheticInput: public ImageInput {
+public:
+	SyntheticInput(const Config& config, const SyntheticOptions& options);
+
+	virtual bool nextImage();
+	virtual std::vector<cv::Rect> getLayout() const { return _layout; }
+
+	const SyntheticTruth& getTruth() const { return _truth; }
+
+private:
+	void nextValues();
+	void render();
+	void drawField(cv::Mat& img, const cv::Rect& box, const std::string& text, int lit);
+	void drawDigit(cv::Mat& img, cv::Point origin, int width, int height, int digit, int lit);
+	static std::vector<cv::Rect> defaultLayout(const cv::Size& size, int digitHeight);
+
+	SyntheticOptions _options;
+	std::vector<cv::Rect> _layout; // kV, mA, power indicator
+	int _digitHeight;
+	cv::RNG _rng;
+	time_t _startTime;
+	SyntheticTruth _truth;
+	cv::Mat _canvas; // noise free 8 bit frame
+	cv::Mat _noise;
+	std::ofstream _truthStream;
+};
+
+#endif /* INCLUDE_SYNTHETICINPUT_H_ */
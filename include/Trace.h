@@ -0,0 +1,73 @@
+#ifndef INCLUDE_TRACE_H_
+#define INCLUDE_TRACE_H_
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+// Per frame tracing of the pipeline stages into a ring of spans, written as Chrome
+// trace event JSON for chrome://tracing or Perfetto. Tracing is off until started;
+// while it is off an instrumentation point costs one relaxed atomic load.
+class Tracer {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	static Tracer& instance();
+	static bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+
+	// Start recording into a ring of the given number of spans, older spans are overwritten.
+	void start(int capacity);
+	void stop();
+
+	// Start the next frame on this thread; its spans carry the frame id.
+	static void beginFrame();
+
+	// Record a span of this thread. name must outlive the tracer, e.g. a string literal.
+	void record(const char* name, Clock::time_point start, Clock::time_point end);
+
+	// The spans in the ring, oldest first.
+	void write(std::ostream& os) const;
+	bool dump(const std::string& filename) const;
+
+private:
+	struct Span {
+		const char* name;
+		uint64_t frame;
+		int64_t startNs;
+		int64_t durationNs;
+		int thread;
+	};
+
+	Tracer() : _next(0) { }
+
+	std::vector<Span> _spans;
+	uint64_t _next; // spans recorded since start
+	mutable std::mutex _mutex;
+
+	static std::atomic<bool> _enabled;
+	static std::atomic<uint64_t> _frames;
+};
+
+// Records the lifetime of a scope as a span while tracing is enabled.
+class TraceSpan {
+public:
+	explicit TraceSpan(const char* name) : _name(Tracer::enabled() ? name : nullptr) {
+		if (_name) {
+			_start = Tracer::Clock::now();
+		}
+	}
+	~TraceSpan() {
+		if (_name) {
+			Tracer::instance().record(_name, _start, Tracer::Clock::now());
+		}
+	}
+private:
+	const char* _name;
+	Tracer::Clock::time_point _start;
+};
+
+#endif /* INCLUDE_TRACE_H_ */
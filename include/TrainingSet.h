@@ -0,0 +1,25 @@
+#ifndef INCLUDE_TRAININGSET_H_
+#define INCLUDE_TRAININGSET_H_
+
+#include <string>
+#include <vector>
+
+// Labeled digit crops for non-interactive training.
+class TrainingSet {
+public:
+	bool add(const std::string& source);
+	bool addDirectory(const std::string& path);
+	bool addManifest(const std::string& filename);
+
+	size_t size() const { return _files.size(); }
+	const std::string& getFile(size_t i) const { return _files[i]; }
+	char getLabel(size_t i) const { return _labels[i]; }
+
+private:
+	static bool isLabel(char label);
+
+	std::vector<std::string> _files;
+	std::vector<char> _labels;
+};
+
+#endif /* INCLUDE_TRAININGSET_H_ */
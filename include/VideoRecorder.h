@@ -0,0 +1,69 @@
+#ifndef INCLUDE_VIDEORECORDER_H_
+#define INCLUDE_VIDEORECORDER_H_
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core/core.hpp>
+#include <opencv2/videoio.hpp>
+
+// Records frames on a dedicated encoder thread.
+// Frames are copied into a bounded ring of preallocated slots; when the encoder falls
+// behind, frames are dropped according to the drop policy and counted.
+// Files can be rotated by size or age, keeping only the newest ones, and restricted to a
+// region of interest.
+class VideoRecorder {
+public:
+	enum DropPolicy { DROP_OLDEST, DROP_NEWEST };
+
+	VideoRecorder(const std::string& basename, double fps, int queueSize = 8, DropPolicy policy = DROP_OLDEST);
+	~VideoRecorder();
+
+	void setRotation(long maxBytes, int maxSeconds, int keepFiles = 0);
+	void setRoi(const cv::Rect& roi);
+
+	void start();
+	void stop();
+	void write(const cv::Mat& frame);
+
+	long getFramesWritten();
+	long getFramesDropped();
+
+	static DropPolicy parseDropPolicy(const std::string& policy);
+
+private:
+	void run();
+	bool openFile(const cv::Size& size);
+	bool rotationDue();
+	void removeOldFiles();
+
+	std::string _basename;
+	double _fps;
+	DropPolicy _policy;
+	long _maxBytes;
+	int _maxSeconds;
+	int _keepFiles;
+	cv::Rect _roi;
+
+	// frame ring, guarded by _mutex
+	std::vector<cv::Mat> _slots;
+	int _head;
+	int _count;
+	bool _running;
+	long _written;
+	long _dropped;
+	std::mutex _mutex;
+	std::condition_variable _cond;
+	std::thread _thread;
+
+	// encoder thread only
+	cv::VideoWriter _writer;
+	std::string _filename;
+	time_t _opened;
+	bool _failed;
+};
+
+#endif /* INCLUDE_VIDEORECORDER_H_ */
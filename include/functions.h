@@ -2,13 +2,35 @@
 #define INCLUDE_FUNCTIONS_H_
 
 #include <fstream>
-#include <opencv2/highgui.hpp>
+#include <memory>
+#include <sstream>
+#include <csignal>
+#include <cstring>
+#include <cmath>
+#include <ctime>
 #include <opencv2/videoio.hpp>
-
-#include "Plausi.h"
+#ifndef KNNOCR_NO_HIGHGUI
+#include <opencv2/highgui.hpp>
+#endif
+
+#include "ChannelValidator.h"
+#include "ReadingStore.h"
+#include "VideoRecorder.h"
+#include "ReadingBus.h"
+#include "Metrics.h"
+#include "Log.h"
+#include "FrameScheduler.h"
+#include "Engine.h"
 #include "KNearestOcr.h"
+#include "TrainingSet.h"
+#include "ModelEvaluator.h"
+#include "Benchmark.h"
+#include "SyntheticInput.h"
+#include "FlightRecorder.h"
+#include "GlyphClusters.h"
 
 int DELAY = 500;
+bool HEADLESS = false;
 
 cv::Rect cropRect(0,0,0,0);
 cv::Point P1(0,0), P2(0,0);
@@ -17,108 +39,310 @@ std::vector<cv::Rect> blackPoint;
 bool clicked=false;
 bool calc=false;
 
+ROIBox* setROIBOX(ImageInput* pImageInput, Config& config, bool select = false);
+#ifndef KNNOCR_NO_HIGHGUI
 void onMouseCropImage(int event, int x, int y, int f, void *param);
-ROIBox* setROIBOX(ImageInput* pImageInput);
 void recordData(int cam);
+#endif
+
+static volatile sig_atomic_t quitRequested = 0;
+
+static void onQuitSignal(int) {
+	quitRequested = 1;
+}
+
+
+// Copy the digits of a channel into a bus record.
+static void setBusChannel(const ChannelResult& channel, float& value, char* busDigits, float* busConfidence) {
+	value = (float) channel.value;
+	for (size_t i = 0; i < channel.digits.size() && i < (size_t) BusRecord::MAX_DIGITS; i++) {
+		busDigits[i] = channel.digits[i];
+		busConfidence[i] = i < channel.confidence.size() ? channel.confidence[i] : 0.f;
+	}
+}
+
+// Publish the readings of a frame to local consumers.
+static void publishReadings(ReadingBus& bus, uint64_t frame, const FrameResult& result) {
+	BusRecord record;
+	memset(&record, 0, sizeof(record));
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	record.timeNs = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+	record.frame = frame;
+	record.powerOn = result.powerOn;
+	record.kVChecked = result.kV.status == ChannelValidator::ACCEPTED;
+	record.mAChecked = result.mA.status == ChannelValidator::ACCEPTED;
+	setBusChannel(result.kV, record.kV, record.kVDigits, record.kVConfidence);
+	setBusChannel(result.mA, record.mA, record.mADigits, record.mAConfidence);
+	bus.publish(record);
+	Metrics::instance().busPublished.inc();
+}
+
+// Copy the ROI boxes of the frame onto a black image of its size and type.
+static void maskRoi(const cv::Mat& img, cv::Mat& masked) {
+	if (masked.size() != img.size() || masked.type() != img.type()) {
+		masked = cv::Mat::zeros(img.size(), img.type());
+	}
+	for (const cv::Rect& box : blackBox) {
+		img(box).copyTo(masked(box));
+	}
+}
 
+// Bounding box of all ROI boxes.
+static cv::Rect roiBounds() {
+	cv::Rect bounds;
+	for (const cv::Rect& box : blackBox) bounds |= box;
+	return bounds;
+}
+
+static bool ocrRejected(const ChannelResult& channel) {
+	return channel.digits.find_first_of("?.") != std::string::npos;
+}
+
+// Why the flight recorder should keep the frames around this one, null if nothing happened.
+// Unstable readings are not an anomaly, they are normal while a value is being changed.
+// wasPowerOn is the power state of the previous frame, -1 for the first frame.
+static const char* anomaly(const FrameResult& result, int wasPowerOn) {
+	if (wasPowerOn >= 0 && result.powerOn != (wasPowerOn != 0)) {
+		return result.powerOn ? "power-on" : "power-off";
+	}
+	if (ocrRejected(result.kV) || ocrRejected(result.mA)) {
+		return "ocr-reject";
+	}
+	for (const ChannelResult* channel : { &result.kV, &result.mA }) {
+		if (channel->status == ChannelValidator::REJECTED_RANGE || channel->status == ChannelValidator::REJECTED_RATE) {
+			return "rejected";
+		}
+	}
+	return nullptr;
+}
+
+// Flight recorder of the config, started.
+static void startFlightRecorder(FlightRecorder& flight, const Config& config) {
+	if (config.getFlightRoiOnly()) {
+		flight.setRoi(roiBounds());
+	}
+	flight.start();
+}
+
+// Capture the next frame, timed and counted.
+static bool captureFrame(ImageInput* pImageInput) {
+	Metrics& metrics = Metrics::instance();
+	Tracer::beginFrame();
+	StageTimer timer(metrics.capture, "nextImage");
+	if (!pImageInput->nextImage()) {
+		metrics.captureFailures.inc();
+		return false;
+	}
+	metrics.framesCaptured.inc();
+	return true;
+}
+
+#ifndef KNNOCR_NO_HIGHGUI
+// Show a digit and learn the key pressed: <0>..<9>, <.> add a sample, <x> drops the nearest sample.
+static int learnDigit(KNearestOcr& ocr, const cv::Mat& img) {
+	cv::imshow("Learn", img);
+	int key = cv::waitKey(0) & 255;
+	if (key >= 176 && key <= 185) {
+		key -= 128; // numeric keypad
+	}
+	if ((key >= '0' && key <= '9') || key == '.') {
+		ocr.addSample(img, char(key));
+		std::cout << char(key) << std::flush;
+	} else if (key == 'x') {
+		// drop the training sample that is nearest to this digit
+		if (ocr.removeNearest(img) >= 0) {
+			std::cout << 'x' << std::flush;
+		}
+	}
+	return key;
+}
+
+// Learn a vector of digits until <s> or <q> is pressed.
+static int learnDigits(KNearestOcr& ocr, const std::vector<cv::Mat>& images) {
+	int key = 0;
+	for (std::vector<cv::Mat>::const_iterator it = images.begin();
+			it < images.end() && key != 's' && key != 'q'; ++it) {
+		key = learnDigit(ocr, *it);
+	}
+	return key;
+}
+#endif
 
 static void testOcr(ImageInput* pImageInput, int cam) {
-	auto roi = setROIBOX(pImageInput);
 	bool debugOCR(false);
 
 	Config config;
     config.loadConfig();
-    ImageProcessor proc(config);
-    proc.debugWindow();
-    proc.debugDigits();
-    proc.ocrkVmA();
-    proc.debugPower();
-
-    KNearestOcr ocr(config);
-    if (! ocr.loadTrainingData()) {
-        std::cout << "Failed to load OCR training data\n";
+    std::unique_ptr<ROIBox> roi(setROIBOX(pImageInput, config));
+    if (!roi) {
         return;
     }
-    std::cout << "OCR training data loaded.\n";
-    std::cout << "<q> to quit.\n";
+    Engine engine(config);
+    if (!engine.load()) {
+        return;
+    }
+    engine.watchModel();
+    // the GUI shows the steps of its own processor, the engine's one has no debug view
+    DebugImageProcessor proc(config);
+    if (!HEADLESS) {
+        proc.debugWindow();
+        proc.debugDigits();
+    }
 
-    cv::Mat imgNone = cv::Mat::zeros(pImageInput->getImage().rows, pImageInput->getImage().cols, CV_8UC3);
+    if (!engine.usesKnn()) {
+        std::cout << "Using seven segment decoder.\n";
+        if (!HEADLESS) std::cout << "<q> to quit.\n";
+    } else {
+        std::cout << "OCR training data loaded.\n";
+        if (!HEADLESS) std::cout << "<q> to quit, <l> to correct the digits of the current frame, <s> to save training data.\n";
+    }
+
+    ReadingBus bus(config.getBusName(), config.getBusCapacity());
+    bus.open();
+
+    MetricsExporter exporter(config.getMetricsPort(), config.getMetricsFile());
+    exporter.setTrace(config.getTraceFile(), config.getTraceEvents());
+    exporter.start();
+
+    cv::Mat imgCopy;
 
 	// Recording ============
 	double fps = 1/(DELAY * 0.001);
 	int width = pImageInput->getImage().cols;
 	int height = pImageInput->getImage().rows;
-	std::cout << width << " " << height << std::endl;
-	int fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
-
-	cv::VideoWriter outputVideo;
-	outputVideo.open("record.avi", fourcc, fps, cv::Size(width, height), true);
-
-	if (!outputVideo.isOpened()) { std::cerr << "Recording Initialization Error" << std::endl; exit(1); }
+	LOG_DEBUG("Frame size " << width << "x" << height);
+
+	VideoRecorder recorder(config.getRecordFile(), fps, config.getRecordQueueSize(),
+			VideoRecorder::parseDropPolicy(config.getRecordDropPolicy()));
+	recorder.setRotation(config.getRecordMaxMB() * 1024L * 1024L, config.getRecordMaxMinutes() * 60,
+			config.getRecordKeepFiles());
+	if (config.getRecordRoiOnly()) {
+		recorder.setRoi(roiBounds());
+	}
+	recorder.start();
 	// ===============
 
+	FlightRecorder flight(config.getFlightDirectory(), config.getFlightSeconds(), config.getFlightPostSeconds(), DELAY);
+	startFlightRecorder(flight, config);
+
 
-    int frameNo(0);
-    while (1) {
-		pImageInput->nextImage();
-    	std::cout << "Frame " << frameNo++ << std::endl;
-		cv::Mat imgCopy = imgNone;
-		
-		outputVideo.write(pImageInput->getImage());
+    if (HEADLESS) {
+        signal(SIGINT, onQuitSignal);
+        signal(SIGTERM, onQuitSignal);
+    }
+    FrameScheduler scheduler(DELAY, config.getFrameIdlePeriod(), config.getFrameHoldTime());
+    std::string lastVoltage, lastCurrent;
+    int lastPowerOn = -1;
 
-		for (int k=0; k<blackBox.size(); k++) {
-			for (int i=blackBox[k].x; i< blackBox[k].x + blackBox[k].width; i++) {
-				for (int j=blackBox[k].y; j<blackBox[k].y + blackBox[k].height; j++) {
-					imgCopy.at<cv::Vec3b>(j,i) = pImageInput->getImage().at<cv::Vec3b>(j,i);
-				}
+    uint64_t frameNo = 0;
+    while (!quitRequested) {
+		if (!captureFrame(pImageInput) && HEADLESS) {
+			break;
+		}
+		if (pImageInput->getImage().empty()) {
+			// no frame yet, the input failed before the first one
+#ifndef KNNOCR_NO_HIGHGUI
+			if ((cv::waitKey(DELAY) & 255) == 'q') {
+				break;
 			}
+#endif
+			continue;
+		}
+    	LOG_DEBUG("Frame " << frameNo);
+		{
+			TraceSpan span("record");
+			recorder.write(pImageInput->getImage());
+		}
+
+		FrameResult result;
+		if (HEADLESS) {
+			result = engine.process(pImageInput->getImage(), pImageInput->getTime());
+		} else {
+			// the window shows the ROI boxes only
+			maskRoi(pImageInput->getImage(), imgCopy);
+			result = engine.process(proc, imgCopy, pImageInput->getTime());
 		}
-    	proc.setInput(imgCopy);
-        proc.process(roi);
-        bool powerOn = proc.getpowerOn();
-
-        std::cout << "######### KNN RESULTS ########" << std::endl;
-//        std::cout << ">> Voltage OCR -----" << std::endl;
-        std::string voltage = ocr.recognize(proc.getOutputkV());
-//        std::cout << ">> Current OCR -----" << std::endl;
-        std::string current = ocr.recognize(proc.getOutputmA());
-
-
-        if (voltage.find('.') != std::string::npos || current.find('.') != std::string::npos
-		 	||voltage.empty() || current.empty()) {
-        	std::cout << "######### OCR RESULTS ########" << std::endl;
-			if(powerOn)	std::cout << "Power Status: On" << std::endl;
-			else		std::cout << "Power Status: Off" << std::endl;
-			std::cout << "Tube voltage (kV) : " << voltage << std::endl;
-			std::cout << "Tube current (mA) : " << current << std::endl;
-			std::cout << "!!WARNING!! point is recognized or character is not recognized" << std::endl;
+        bool powerOn = result.powerOn;
+        const std::string& voltage = result.kV.digits;
+        const std::string& current = result.mA.digits;
+        {
+            TraceSpan span("output");
+            publishReadings(bus, frameNo, result);
+            flight.record(pImageInput->getImage(), frameNo, result);
+            if (const char* reason = anomaly(result, lastPowerOn)) {
+                flight.trigger(reason);
+            }
         }
-        else {
-        	float currentF = (float)stoi(current) * 0.1;
-			std::cout << "######### OCR RESULTS ########" << std::endl;
-			if(powerOn)	std::cout << "Power Status: On" << std::endl;
-			else		std::cout << "Power Status: Off" << std::endl;
-			std::cout << "Tube voltage (kV) : " << stoi(voltage) << std::endl;
-			std::cout << "Tube current (mA) : " << currentF << std::endl << std::endl;
+        frameNo++;
+        lastPowerOn = powerOn;
+
+        // one line per frame, the console is not free
+        bool parsed = !std::isnan(result.kV.value) && !std::isnan(result.mA.value);
+        if (voltage.find('.') != std::string::npos || current.find('.') != std::string::npos || !parsed) {
+            LOG_INFO("Power " << (powerOn ? "on" : "off") << ", kV " << voltage << ", mA " << current);
+            LOG_WARN_EVERY(5000, "Decimal point or unknown character recognized: kV " << voltage << ", mA " << current);
+        } else {
+            LOG_INFO("Power " << (powerOn ? "on" : "off") << ", kV " << result.kV.value << ", mA " << result.mA.value);
+        }
+        if (result.kV.status == ChannelValidator::ACCEPTED || result.mA.status == ChannelValidator::ACCEPTED) {
+            LOG_INFO("Checked kV " << result.kV.checked.value << ", mA " << result.mA.checked.value);
         }
 
-        int key = cv::waitKey(DELAY) & 255;
+        bool changed = voltage != lastVoltage || current != lastCurrent;
+        lastVoltage = voltage;
+        lastCurrent = current;
 
+        if (HEADLESS) {
+            scheduler.wait(powerOn, changed);
+            continue;
+        }
+#ifndef KNNOCR_NO_HIGHGUI
+        int waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(scheduler.next(powerOn, changed)).count();
+        int key = cv::waitKey(std::max(1, waitMs)) & 255;
         if (key == 'q') {
-            std::cout << "Quit\n";
             break;
+        } else if (key == 'l' && engine.usesKnn()) {
+            // live correction: <0>..<9>, <.> add a sample, <x> drops the nearest sample, <space> skips,
+            // <s> saves and <q> ends the correction
+            int learnKey = learnDigits(engine.getKnn(), proc.getOutputkV());
+            if (learnKey != 's' && learnKey != 'q') {
+                learnKey = learnDigits(engine.getKnn(), proc.getOutputmA());
+            }
+            cv::destroyWindow("Learn");
+            std::cout << "\n" << engine.getKnn().getSampleCount() << " samples in model\n";
+            if (learnKey == 's') {
+                std::cout << "Saving training data\n";
+                engine.getKnn().saveTrainingData();
+            }
+        } else if (key == 's' && engine.usesKnn()) {
+            std::cout << "Saving training data\n";
+            engine.getKnn().saveTrainingData();
         }
+#endif
+    }
+    std::cout << "Quit\n";
+    recorder.stop();
+    std::cout << "Recorded " << recorder.getFramesWritten() << " frames, dropped "
+            << recorder.getFramesDropped() << "\n";
+    flight.stop();
+    if (flight.isEnabled()) {
+        std::cout << "Flight recorder wrote " << flight.getDumps() << " windows to " << config.getFlightDirectory() << "\n";
     }
 }
 
 
+#ifndef KNNOCR_NO_HIGHGUI
 static void learnOcr(ImageInput* pImageInput) {
 	int key = 0;
-	auto roi = setROIBOX(pImageInput);
 
 	Config config;
 	config.loadConfig();
-	ImageProcessor proc(config);
+	std::unique_ptr<ROIBox> roi(setROIBOX(pImageInput, config));
+	if (!roi) {
+		return;
+	}
+	DebugImageProcessor proc(config);
 	proc.debugDigits();
 	proc.debugEdges();
 	proc.debugWindow();
@@ -126,23 +350,15 @@ static void learnOcr(ImageInput* pImageInput) {
 	KNearestOcr ocr(config);
 	ocr.loadTrainingData();
 	std::cout << "## Entering OCR training mode! ##\n";
-	std::cout << "<0>..<9> to answer digit, <.> to answer decimal point, <space> to ignore digit, <s> to save and quit, <q> to quit without saving.\n";
+	std::cout << "<0>..<9> to answer digit, <.> to answer decimal point, <space> to ignore digit, <x> to remove the nearest sample, <s> to save and quit, <q> to quit without saving.\n";
 
-	cv::Mat imgNone = cv::Mat::zeros(pImageInput->getImage().rows, pImageInput->getImage().cols, CV_8UC3);
+	cv::Mat imgCopy;
 	while (pImageInput->nextImage()) {
-		cv::Mat imgCopy = imgNone;
-
-		for (int k=0; k<blackBox.size(); k++) {
-			for (int i=blackBox[k].x; i< blackBox[k].x + blackBox[k].width; i++) {
-				for (int j=blackBox[k].y; j<blackBox[k].y + blackBox[k].height; j++) {
-					imgCopy.at<cv::Vec3b>(j,i) = pImageInput->getImage().at<cv::Vec3b>(j,i);
-				}
-			}
-		}
+		maskRoi(pImageInput->getImage(), imgCopy);
 		proc.setInput(imgCopy);
-		proc.process(roi);
+		proc.process(roi.get());
 
-		key = ocr.learn(proc.getOutput());
+		key = learnDigits(ocr, proc.getOutput());
 		std::cout << "...Learn" << std::endl;
 
 		if (key == 'q' || key == 's') {
@@ -156,37 +372,198 @@ static void learnOcr(ImageInput* pImageInput) {
 		ocr.saveTrainingData();
 	}
 }
+#endif
+
+#ifndef KNNOCR_NO_HIGHGUI
+// Label the glyphs of all input frames by cluster: the glyphs are extracted in parallel and
+// clustered by sample distance, then the operator labels each cluster once from a montage.
+// Up to samplesPerCluster samples, spread from the center to the edge of the cluster, go into
+// the model, so thousands of identical glyphs do not slow down the recognition.
+static void clusterLearnOcr(ImageInput* pImageInput, int clusterCount) {
+	const int framesPerBatch = 64;
+	const int samplesPerCluster = 25;
+	const int drillClusters = 4;
+
+	Config config;
+	config.loadConfig();
+	std::unique_ptr<ROIBox> roi(setROIBOX(pImageInput, config));
+	if (!roi) {
+		return;
+	}
+
+	GlyphClusters clusters(config);
+	std::vector<cv::Mat> frames;
+	int frameCount = 0;
+	// setROIBOX already read the first frame
+	frames.push_back(pImageInput->getImage().clone());
+	bool more = true;
+	while (more) {
+		while ((int) frames.size() < framesPerBatch && (more = pImageInput->nextImage())) {
+			frames.push_back(pImageInput->getImage().clone());
+		}
+		frameCount += (int) frames.size();
+		if (!clusters.extract(frames, roi.get())) {
+			std::cout << "Glyph limit reached, ignoring the remaining frames\n";
+			break;
+		}
+		frames.clear();
+	}
+	clusters.cluster(clusterCount > 0 ? clusterCount : 40);
+	std::cout << "Extracted " << clusters.getGlyphCount() << " glyphs from " << frameCount << " frames into "
+			<< clusters.getClusters().size() << " clusters\n";
+	if (clusters.getGlyphCount() == 0) {
+		return;
+	}
+
+	KNearestOcr ocr(config);
+	if (ocr.loadTrainingData()) {
+		std::cout << "Merging into existing OCR training data.\n";
+	}
+	std::cout << "## Entering cluster labeling mode! ##\n";
+	std::cout << "<0>..<9> to label the cluster, <.> for decimal points, <d> to split an uncertain cluster, <space> to skip it, <s> to save and quit, <q> to quit without saving.\n";
+
+	// largest clusters first, split ones are labeled next
+	std::vector<GlyphClusters::Cluster> pending(clusters.getClusters().rbegin(), clusters.getClusters().rend());
+	int key = 0, labeled = 0;
+	while (!pending.empty()) {
+		GlyphClusters::Cluster cluster = pending.back();
+		pending.pop_back();
+		std::cout << pending.size() << " left, " << cluster.members.size() << " glyphs, spread " << cluster.spread
+				<< ": " << std::flush;
+		cv::imshow("Cluster", clusters.montage(cluster));
+		key = cv::waitKey(0) & 255;
+		if (key >= 176 && key <= 185) {
+			key -= 128; // numeric keypad
+		}
+		if ((key >= '0' && key <= '9') || key == '.') {
+			ocr.addSamples(clusters.getSamples(cluster, samplesPerCluster), char(key));
+			labeled += (int) cluster.members.size();
+			std::cout << char(key) << "\n";
+		} else if (key == 'd' && cluster.members.size() > 1) {
+			std::vector<GlyphClusters::Cluster> parts = clusters.split(cluster, drillClusters);
+			pending.insert(pending.end(), parts.rbegin(), parts.rend());
+			std::cout << "split into " << parts.size() << "\n";
+		} else if (key == 'q' || key == 's') {
+			std::cout << "Quit\n";
+			break;
+		} else {
+			std::cout << "skipped\n";
+		}
+	}
+	cv::destroyWindow("Cluster");
+
+	std::cout << "Labeled " << labeled << " of " << clusters.getGlyphCount() << " glyphs\n";
+	if (key != 'q' && labeled > 0) {
+		std::cout << "Saving training data\n";
+		ocr.saveTrainingData();
+	}
+}
+#endif
+
+static void bulkLearnOcr(const std::string& source, bool merge) {
+	Config config;
+	config.loadConfig();
+
+	TrainingSet trainingSet;
+	if (! trainingSet.add(source)) {
+		std::cout << "No labeled digits found in " << source << "\n";
+		return;
+	}
+
+	KNearestOcr ocr(config);
+	if (merge && ocr.loadTrainingData()) {
+		std::cout << "Merging into existing OCR training data.\n";
+	}
+	int learned = ocr.learn(trainingSet, merge);
+	std::cout << "Learned " << learned << " of " << trainingSet.size() << " digits.\n";
+
+	if (learned > 0 && ocr.hasTrainingData()) {
+		std::cout << "Saving training data\n";
+		ocr.saveTrainingData();
+	}
+}
+
+static void evaluateOcr(int folds) {
+	Config config;
+	config.loadConfig();
+
+	KNearestOcr ocr(config);
+	if (! ocr.loadTrainingData() || ! ocr.hasTrainingData()) {
+		std::cout << "Failed to load OCR training data\n";
+		return;
+	}
+	ModelEvaluator evaluator(config, ocr.getSamples(), ocr.getResponses());
+	evaluator.evaluate(folds);
+}
+
+// Run the pipeline on the input frames with no GUI and no sleeping and report its performance.
+// The report goes to stdout and as JSON to jsonFile ("-" for stdout).
+static void benchmark(ImageInput* pImageInput, const std::string& jsonFile) {
+	const int maxFrames = 256;  // distinct frames kept in memory
+	const int minRuns = 1000;   // frames processed at least
+
+	Config config;
+	config.loadConfig();
+	HEADLESS = true;
+	std::unique_ptr<ROIBox> roi(setROIBOX(pImageInput, config));
+	if (!roi) {
+		return;
+	}
+
+	Benchmark bench(config);
+	if (!bench.load()) {
+		return;
+	}
+	// synthetic frames come with the values they show
+	SyntheticInput* synthetic = dynamic_cast<SyntheticInput*>(pImageInput);
+	// setROIBOX already read the first frame
+	do {
+		if (synthetic) {
+			bench.addFrame(pImageInput->getImage(), synthetic->getTruth().kVValue, synthetic->getTruth().mAValue);
+		} else {
+			bench.addFrame(pImageInput->getImage());
+		}
+	} while (bench.getFrameCount() < maxFrames && pImageInput->nextImage());
+	bench.run(std::max(minRuns, bench.getFrameCount()));
+	bench.report(std::cout);
+
+	if (jsonFile == "-") {
+		bench.writeJson(std::cout);
+	} else if (!jsonFile.empty()) {
+		std::ofstream ofs(jsonFile.c_str());
+		bench.writeJson(ofs);
+		if (!ofs) {
+			std::cerr << "Failed to write " << jsonFile << "\n";
+		}
+	}
+}
 
+#ifndef KNNOCR_NO_HIGHGUI
 static void adjustCamera(ImageInput* pImageInput) {
 	bool processImage(true);
 	int key(0);
 
-	auto roi = setROIBOX(pImageInput);
-
 	Config config;
 	config.loadConfig();
-	ImageProcessor proc(config);
+	// adjusting always selects a new ROI layout
+	std::unique_ptr<ROIBox> roi(setROIBOX(pImageInput, config, true));
+	if (!roi) {
+		return;
+	}
+	DebugImageProcessor proc(config);
 	proc.debugDigits();
 	proc.debugEdges();
 	proc.debugWindow();
 	std::cout <<"## ADJUST CAMERA ##\n";
 	std::cout << "<r>, <p> to select raw or processed image, <s> to save config and quit, <q> to quit without saving.\n";
 
-	cv::Mat imgNone = cv::Mat::zeros(pImageInput->getImage().rows, pImageInput->getImage().cols, CV_8UC3);
+	cv::Mat imgCopy;
 	while (pImageInput->nextImage()) {
-		cv::Mat imgCopy = imgNone;
-
-		for (int k=0; k<blackBox.size(); k++) {
-			for (int i=blackBox[k].x; i< blackBox[k].x + blackBox[k].width; i++) {
-				for (int j=blackBox[k].y; j<blackBox[k].y + blackBox[k].height; j++) {
-					imgCopy.at<cv::Vec3b>(j,i) = pImageInput->getImage().at<cv::Vec3b>(j,i);
-				}
-			}
-		}
+		maskRoi(pImageInput->getImage(), imgCopy);
 
 		if (processImage) {
 			proc.setInput(imgCopy);
-			proc.process(roi);
+			proc.process(roi.get());
 		}
 		else {
 			proc.setInput(pImageInput->getImage());
@@ -210,6 +587,7 @@ static void adjustCamera(ImageInput* pImageInput) {
 	}
 
 }
+#endif
 
 static void capture(ImageInput* pImageInput) {
 	std::cout << "Capturing images into directory.\n";
@@ -223,32 +601,141 @@ static void capture(ImageInput* pImageInput) {
 static void writeData(ImageInput* pImageInput) {
 	Config config;
 	config.loadConfig();
-	ImageProcessor proc(config);
-
-	Plausi plausi;
-
-	KNearestOcr ocr(config);
-	if (! ocr.loadTrainingData()) {
-		std::cout << "Failed to load OCR training data\n";
+	std::unique_ptr<ROIBox> roi(setROIBOX(pImageInput, config));
+	if (!roi) {
 		return;
 	}
-	std::cout << "OCR training data loaded.\n";
-	std::cout << "<Ctrl-C> to quit.\n";
+	Engine engine(config);
+	if (!engine.load()) {
+		return;
+	}
+	engine.watchModel();
+	if (engine.usesKnn()) {
+		std::cout << "OCR training data loaded.\n";
+	} else {
+		std::cout << "Using seven segment decoder.\n";
+	}
 
-	while (pImageInput->nextImage()) {
-		proc.setInput(pImageInput->getImage());
-		proc.process();
+	ReadingStore store(config.getStoreDirectory(), config.getStoreBatchSize(),
+			ReadingStore::parseFsyncPolicy(config.getStoreFsync()), config.getStoreFsyncInterval());
+	if (! store.open()) {
+		return;
+	}
 
-		std::string result = ocr.recognize(proc.getOutput());
-		if (plausi.check(result, pImageInput->getTime())) {
-			plausi.getCheckedValue();
+	ReadingBus bus(config.getBusName(), config.getBusCapacity());
+	bus.open();
+
+	MetricsExporter exporter(config.getMetricsPort(), config.getMetricsFile());
+	exporter.setTrace(config.getTraceFile(), config.getTraceEvents());
+	exporter.start();
+	std::cout << "Writing readings to " << config.getStoreDirectory() << ", <Ctrl-C> to quit.\n";
+
+	// leave the loop on Ctrl-C so the store flushes its last batch
+	signal(SIGINT, onQuitSignal);
+	signal(SIGTERM, onQuitSignal);
+
+	FlightRecorder flight(config.getFlightDirectory(), config.getFlightSeconds(), config.getFlightPostSeconds(), DELAY);
+	startFlightRecorder(flight, config);
+
+	FrameScheduler scheduler(DELAY, config.getFrameIdlePeriod(), config.getFrameHoldTime());
+	std::string lastVoltage, lastCurrent;
+	int lastPowerOn = -1;
+	uint64_t frameNo = 0;
+	while (!quitRequested && captureFrame(pImageInput)) {
+		FrameResult result = engine.process(pImageInput->getImage(), pImageInput->getTime());
+		{
+			TraceSpan span("output");
+			if (result.kV.status == ChannelValidator::ACCEPTED) {
+				store.append(ReadingStore::KV, result.kV.checked);
+			}
+			if (result.mA.status == ChannelValidator::ACCEPTED) {
+				store.append(ReadingStore::MA, result.mA.checked);
+			}
+			LOG_DEBUG("Frame " << frameNo << ": kV " << result.kV.digits << ", mA " << result.mA.digits);
+			flight.record(pImageInput->getImage(), frameNo, result);
+			if (const char* reason = anomaly(result, lastPowerOn)) {
+				flight.trigger(reason);
+			}
+			publishReadings(bus, frameNo++, result);
 		}
+		lastPowerOn = result.powerOn;
 
-		usleep(DELAY*1000L);
+		bool changed = result.kV.digits != lastVoltage || result.mA.digits != lastCurrent;
+		lastVoltage = result.kV.digits;
+		lastCurrent = result.mA.digits;
+		scheduler.wait(result.powerOn, changed);
+	}
+	LOG_INFO(scheduler.getFrames() << " frames, " << scheduler.getMissed() << " missed their deadline");
+	flight.stop();
+}
 
+// Parse "YYYYmmdd-HHMMSS" (local time) or seconds since the epoch.
+static time_t parseTime(const std::string& str) {
+	if (str.size() == 15 && str[8] == '-') {
+		struct tm date;
+		memset(&date, 0, sizeof(date));
+		date.tm_year = atoi(str.substr(0, 4).c_str()) - 1900;
+		date.tm_mon = atoi(str.substr(4, 2).c_str()) - 1;
+		date.tm_mday = atoi(str.substr(6, 2).c_str());
+		date.tm_hour = atoi(str.substr(9, 2).c_str());
+		date.tm_min = atoi(str.substr(11, 2).c_str());
+		date.tm_sec = atoi(str.substr(13, 2).c_str());
+		date.tm_isdst = -1;
+		return mktime(&date);
 	}
+	return (time_t) atoll(str.c_str());
 }
 
+// Print stored readings as CSV. range is "<from>,<to>[,1m]".
+static void queryData(const std::string& range) {
+	std::vector<std::string> fields;
+	std::stringstream ss(range);
+	std::string field;
+	while (std::getline(ss, field, ',')) {
+		fields.push_back(field);
+	}
+	if (fields.size() < 2) {
+		std::cerr << "*** Query range must be <from>,<to>[,1m]\n";
+		return;
+	}
+	time_t from = parseTime(fields[0]);
+	time_t to = parseTime(fields[1]);
+	bool rollups = fields.size() > 2 && fields[2] == "1m";
+
+	Config config;
+	config.loadConfig();
+	ReadingStore store(config.getStoreDirectory());
+
+	auto formatTime = [](int64_t t) {
+		time_t tt = (time_t) t;
+		struct tm date;
+		char buf[32];
+		localtime_r(&tt, &date);
+		strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &date);
+		return std::string(buf);
+	};
+
+	bool found = false;
+	for (int c = 0; c < ReadingStore::NUM_CHANNELS; c++) {
+		if (rollups) {
+			if (c == 0) std::cout << "time,channel,count,min,max,mean\n";
+			found |= store.queryRollups((ReadingStore::Channel) c, from, to, [&](const ReadingStore::Rollup& r) {
+				std::cout << formatTime(r.time) << "," << ReadingStore::channelName(r.channel) << "," << r.count
+						<< "," << r.min << "," << r.max << "," << r.mean << "\n";
+			});
+		} else {
+			if (c == 0) std::cout << "time,channel,value\n";
+			found |= store.query((ReadingStore::Channel) c, from, to, [&](const ReadingStore::Record& r) {
+				std::cout << formatTime(r.time) << "," << ReadingStore::channelName(r.channel) << "," << r.value << "\n";
+			});
+		}
+	}
+	if (!found) {
+		std::cerr << "No reading store in " << config.getStoreDirectory() << "\n";
+	}
+}
+
+#ifndef KNNOCR_NO_HIGHGUI
 void onMouseCropImage(int event, int x, int y, int f, void *param){
 	switch (event) {
     case cv::EVENT_LBUTTONDOWN:
@@ -293,10 +780,46 @@ void onMouseCropImage(int event, int x, int y, int f, void *param){
         }
     }
 }
+#endif
+
+// Use the ROI layout persisted in the config or known to the input, or let the user select one if there is none
+// or select is set. A new selection is saved to the config unless select is set, then the caller saves it.
+// Returns null without a usable layout.
+ROIBox* setROIBOX(ImageInput* pImageInput, Config& config, bool select) {
+	// an input that knows its layout, e.g. synthetic frames, needs no selection; it is not saved
+	if (!select && config.getRoiBoxes().empty() && !pImageInput->getLayout().empty()) {
+		config.setRoiBoxes(pImageInput->getLayout());
+	}
+	if (!select && !config.getRoiBoxes().empty()) {
+		// the first frame gives the frame size
+		if (!pImageInput->nextImage()) {
+			LOG_ERROR("No image from input");
+			return nullptr;
+		}
+		cv::Rect frame(0, 0, pImageInput->getImage().cols, pImageInput->getImage().rows);
+		for (const cv::Rect& box : config.getRoiBoxes()) {
+			if ((box & frame) != box) {
+				LOG_ERROR("ROI box " << box << " exceeds the frame " << frame.size() << ", select a new layout with -a");
+				return nullptr;
+			}
+		}
+		blackBox = config.getRoiBoxes();
+		ROIBox* roi = new ROIBox();
+		roi->setROIBox(blackBox);
+		return roi;
+	}
+#ifdef KNNOCR_NO_HIGHGUI
+	LOG_ERROR("No ROI layout in config.yml, this build has no display to select one: add roiBoxes to config.yml");
+	return nullptr;
+#else
+	if (HEADLESS) {
+		LOG_ERROR("No ROI layout in config.yml, select one with -a on a display first");
+		return nullptr;
+	}
 
-ROIBox* setROIBOX(ImageInput* pImageInput) {
 	ROIBox* roi = new ROIBox();
 	bool pushcrop = false;
+	blackBox.clear();
 
 	// Set ROI
 	std::cout << ">> Select ROI box to OCR, Last ROI box will check the On/Off" << std::endl;
@@ -333,9 +856,24 @@ ROIBox* setROIBOX(ImageInput* pImageInput) {
 	cv::destroyAllWindows();
 	roi->setROIBox(blackBox);
 
+	// kV and mA display plus the power indicator
+	if (blackBox.size() < 3) {
+		LOG_ERROR("Select at least 3 ROI boxes: kV, mA and power indicator last");
+		delete roi;
+		return nullptr;
+	}
+	config.setRoiBoxes(blackBox);
+	// adjusting saves the layout with the rest of the config on <s> only
+	if (!select) {
+		config.saveConfig();
+		LOG_INFO("ROI layout saved to config.yml");
+	}
+
 	return roi;
+#endif
 }
 
+#ifndef KNNOCR_NO_HIGHGUI
 void recordData(int cam) {
 	std::cout << "Record Video" << std::endl;
 	
@@ -367,5 +905,6 @@ void recordData(int cam) {
 		if (cv::waitKey(wait) >= 0) break;
 	}
 }
+#endif
 
 #endif /* INCLUDE_FUNCTIONS_H_ */
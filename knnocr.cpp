@@ -9,26 +9,53 @@
 #include <sys/stat.h>
 
 #include "ImageInput.h"
+#include "SyntheticInput.h"
 #include "ImageProcessor.h"
 #include "KNearestOcr.h"
-#include "Plausi.h"
+#include "ChannelValidator.h"
 #include "functions.h"
+#include "Log.h"
 
 static void usage(const char* progname) {
     std::cout << "Program to read and recognize the counter of an electricity meter with OpenCV.\n";
-    std::cout << "Usage: " << progname << " [-i <dir>|-c <cam>] [-l|-t|-a|-w|-o <dir>] [-s <delay>] [-v <level>\n";
+    std::cout << "Usage: " << progname << " [-i <dir>|-c <cam>|-d <device>|-f <video>|-S <spec>] [-l|-t|-a|-w|-o <dir>|-b <json>] [-s <delay>] [-v <level>] [-H]\n";
+    std::cout << "       " << progname << " -L|-M <dir|csv> | -e <folds> | -q <from>,<to>[,1m]\n";
     std::cout << "\nImage input:\n";
     std::cout << "  -i <image directory> : read image files (png) from directory.\n";
     std::cout << "  -c <camera number> : read images from camera.\n";
+    std::cout << "  -d <device> : read gray images from a V4L2 device (GREY or YUYV), e.g. /dev/video0.\n";
+    std::cout << "                <file>:<width>x<height> reads raw GREY frames, or YUYV if the file ends in .yuyv.\n";
+    std::cout << "  -f <video file> : read images from a video file.\n";
+    std::cout << "  -S <key=value,...> : render synthetic kV/mA displays with known values for load testing.\n";
+    std::cout << "                Keys: width, height, fps, frames, noise, blur, drift, driftFrames, rotate,\n";
+    std::cout << "                change, power, kVMin, kVMax, mAMin, mAMax, seed, gray, truth (ground truth CSV).\n";
+    std::cout << "                Uses the ROI layout of config.yml, or its own if there is none. \"\" for the defaults.\n";
     std::cout << "\nOperation:\n";
-    std::cout << "  -a : adjust camera.\n";
+    std::cout << "  -a : adjust camera and select the ROI layout (kV, mA, ..., power indicator last).\n";
     std::cout << "  -o <directory> : capture images into directory.\n";
     std::cout << "  -l : learn OCR.\n";
+    std::cout << "  -C <clusters> : learn OCR by cluster: extract the glyphs of all input frames, group them into\n";
+    std::cout << "                  about <clusters> clusters of similar glyphs and label each cluster once.\n";
     std::cout << "  -t : test OCR.\n";
-    std::cout << "  -w : write OCR data to RR database. This is the normal working mode.\n";
+    std::cout << "  -w : write validated OCR data to the reading store. This is the normal working mode.\n";
+    std::cout << "  -L <dir|csv> : learn OCR from labeled digit crops without user interaction and replace training data.\n";
+    std::cout << "                 <dir> holds one sub-directory per class (0..9, dot), <csv> lines are <image>,<label>.\n";
+    std::cout << "  -M <dir|csv> : like -L, but merge into existing training data.\n";
+    std::cout << "  -e <folds> : evaluate OCR training data with k-fold cross validation, 0 for leave-one-out.\n";
+    std::cout << "  -b <json file> : benchmark the recognition on the input with the saved ROI layout, no GUI, no sleeping.\n";
+    std::cout << "                   Prints frames/s, p50/p99 per stage, and peak RSS,\n";
+    std::cout << "                   and writes them as JSON to <json file> (- for stdout).\n";
+    std::cout << "                   knnocr-allocs, built with the benchmarks, also counts allocations per frame.\n";
+    std::cout << "  -q <from>,<to>[,1m] : print stored readings (or per-minute rollups) as CSV.\n";
+    std::cout << "                        Times are YYYYmmdd-HHMMSS or seconds since the epoch.\n";
     std::cout << "\nOptions:\n";
-    std::cout << "  -s <n> : Sleep n milliseconds after processing of each image (default=1000).\n";
-    std::cout << "  -v <l> : Log level. One of DEBUG, INFO, ERROR (default).\n";
+    std::cout << "  -s <n> : Frame period in milliseconds while the tube is active (default=500).\n";
+    std::cout << "           Idle period (frameIdlePeriod) and hold time (frameHoldTime) are set in config.yml.\n";
+    std::cout << "  -v <l> : Log level. One of DEBUG, INFO (default), WARN, ERROR, OFF.\n";
+    std::cout << "  -H : Headless, no windows. Uses the ROI layout saved by -a and paces frames by timer.\n";
+#ifdef KNNOCR_NO_HIGHGUI
+    std::cout << "       This build has no display support and always runs headless, -l, -C and -a are not available.\n";
+#endif
 }
 
 int main(int argc, char** argv) {
@@ -37,14 +64,24 @@ int main(int argc, char** argv) {
 	ImageInput* pImageInput = 0;
 	int inputCount = 0;
 	std::string outputDir;
-	std::string logLevel = "ERROR";
+	std::string trainingSource;
+	int folds = 0;
+	int clusterCount = 0;
+	std::string queryRange;
+	std::string benchmarkFile;
+	Logger::Level logLevel = Logger::INFO;
 	char cmd = 0;
 	int cmdCount = 0;
 	int cam = 0;
 
 	// recordData(atoi(argv[2]));
 
-	while ((opt = getopt(argc, argv, "i:c:ltaws:o:v:h:r")) != -1) {
+#ifdef KNNOCR_NO_HIGHGUI
+	// built without display support
+	HEADLESS = true;
+#endif
+
+	while ((opt = getopt(argc, argv, "i:c:d:f:S:ltaws:o:v:h:rL:M:e:q:Hb:C:")) != -1) {
 		switch (opt) {
 			case 'i':
 				pImageInput = new DirectoryInput(Directory(optarg, ".png"));
@@ -55,6 +92,32 @@ int main(int argc, char** argv) {
 				inputCount++;
 				cam = atoi(optarg);
 				break;
+			case 'd':
+				pImageInput = createLumaInput(optarg);
+				if (!pImageInput) {
+					std::cerr << "*** Invalid device " << optarg << "\n\n";
+					usage(argv[0]);
+					exit(EXIT_FAILURE);
+				}
+				inputCount++;
+				break;
+			case 'f':
+				pImageInput = new VideoInput(optarg);
+				inputCount++;
+				break;
+			case 'S': {
+				SyntheticOptions options;
+				if (!options.parse(optarg)) {
+					std::cerr << "*** Invalid synthetic input " << optarg << "\n\n";
+					usage(argv[0]);
+					exit(EXIT_FAILURE);
+				}
+				Config config;
+				config.loadConfig();
+				pImageInput = new SyntheticInput(config, options);
+				inputCount++;
+				break;
+			}
 			case 'l':
 			case 't':
 			case 'a':
@@ -67,11 +130,44 @@ int main(int argc, char** argv) {
 				cmdCount++;
 				outputDir = optarg;
 				break;
+			case 'L':
+			case 'M':
+				cmd = opt;
+				cmdCount++;
+				trainingSource = optarg;
+				break;
+			case 'e':
+				cmd = opt;
+				cmdCount++;
+				folds = atoi(optarg);
+				break;
+			case 'C':
+				cmd = opt;
+				cmdCount++;
+				clusterCount = atoi(optarg);
+				break;
+			case 'q':
+				cmd = opt;
+				cmdCount++;
+				queryRange = optarg;
+				break;
+			case 'b':
+				cmd = opt;
+				cmdCount++;
+				benchmarkFile = optarg;
+				break;
 			case 's':
 				DELAY = atoi(optarg);
 				break;
+			case 'H':
+				HEADLESS = true;
+				break;
 			case 'v':
-				logLevel = optarg;
+				if (!Logger::parseLevel(optarg, logLevel)) {
+					std::cerr << "*** Unknown log level " << optarg << "\n\n";
+					usage(argv[0]);
+					exit(EXIT_FAILURE);
+				}
 				break;
 			case 'h':
 			default:
@@ -84,7 +180,9 @@ int main(int argc, char** argv) {
 				break;
 		}
 	}
-	if (inputCount != 1) {
+	Logger::instance().setLevel(logLevel);
+
+	if (inputCount != 1 && cmd != 'L' && cmd != 'M' && cmd != 'e' && cmd != 'q') {
 		std::cerr << "*** You should specify exactly one camera or input directory!\n\n";
 		usage(argv[0]);
 		exit(EXIT_FAILURE);
@@ -94,24 +192,49 @@ int main(int argc, char** argv) {
 		usage(argv[0]);
 		exit(EXIT_FAILURE);
 	}
+	if (HEADLESS && (cmd == 'l' || cmd == 'a' || cmd == 'C')) {
+		std::cerr << "*** Learning and adjusting need a display, they cannot run headless!\n\n";
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
 
 	switch (cmd) {
 		case 'o':
 			pImageInput->setOutputDir(outputDir);
 			capture(pImageInput);
 			break;
+#ifndef KNNOCR_NO_HIGHGUI
 		case 'l':
 			learnOcr(pImageInput);
 			break;
+		case 'C':
+			clusterLearnOcr(pImageInput, clusterCount);
+			break;
+#endif
 		case 't':
 			testOcr(pImageInput, cam);
 			break;
+#ifndef KNNOCR_NO_HIGHGUI
 		case 'a':
 			adjustCamera(pImageInput);
 			break;
+#endif
 		case 'w':
 			writeData(pImageInput);
 			break;
+		case 'L':
+		case 'M':
+			bulkLearnOcr(trainingSource, cmd == 'M');
+			break;
+		case 'e':
+			evaluateOcr(folds);
+			break;
+		case 'q':
+			queryData(queryRange);
+			break;
+		case 'b':
+			benchmark(pImageInput, benchmarkFile);
+			break;
 		// case 'r':
 		// 	std::cout << "Record Video!!" << std::endl;
 		// 	recordData(atoi(optarg));
@@ -0,0 +1,90 @@
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+
+#include "AllocationCounter.h"
+
+#ifdef __GLIBC__
+
+// glibc exports its allocator under these names, so the definitions below replace
+// malloc for the whole process, OpenCV included, and still end up in glibc. Every
+// block comes from glibc, so malloc_usable_size and malloc_trim keep working unchanged.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void* __libc_valloc(size_t size);
+void* __libc_pvalloc(size_t size);
+void __libc_free(void* ptr);
+}
+
+static std::atomic<uint64_t> allocations(0);
+
+extern "C" void* malloc(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+extern "C" void* memalign(size_t alignment, size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return __libc_memalign(alignment, size);
+}
+
+// aligned operator new allocates here
+extern "C" void* aligned_alloc(size_t alignment, size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return __libc_memalign(alignment, size);
+}
+
+// cv::fastMalloc allocates Mat buffers here
+extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size) {
+	if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0) {
+		return EINVAL;
+	}
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = __libc_memalign(alignment, size);
+	if (!p) {
+		return ENOMEM;
+	}
+	*ptr = p;
+	return 0;
+}
+
+extern "C" void* valloc(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return __libc_valloc(size);
+}
+
+extern "C" void* pvalloc(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return __libc_pvalloc(size);
+}
+
+extern "C" void free(void* ptr) {
+	__libc_free(ptr);
+}
+
+bool allocationCount(uint64_t& count) {
+	count = allocations.load(std::memory_order_relaxed);
+	return true;
+}
+
+#else
+
+bool allocationCount(uint64_t& count) {
+	count = 0;
+	return false;
+}
+
+#endif
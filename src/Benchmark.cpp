@@ -0,0 +1,162 @@
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <iomanip>
+#include <sys/resource.h>
+
+#include "Benchmark.h"
+#include "AllocationCounter.h"
+
+Benchmark::Benchmark(const Config& config) :
+		_config(config), _engine(config, _metrics), _measured(0), _seconds(0.), _peakRssKb(0), _labeled(0),
+		_kVCorrect(0), _mACorrect(0), _allocationsPerFrame(-1.) {
+}
+
+// Frames are kept in memory, so reading files or decoding video is not measured.
+void Benchmark::addFrame(const cv::Mat& frame) {
+	addFrame(frame, NAN, NAN);
+}
+
+void Benchmark::addFrame(const cv::Mat& frame, double kV, double mA) {
+	_frames.push_back(frame.clone());
+	_truth.push_back(cv::Vec2d(kV, mA));
+}
+
+// Process the given number of frames, cycling through the loaded ones, after a warmup.
+void Benchmark::run(int frames, int warmup) {
+	for (int s = 0; s < STAGES; s++) {
+		_micros[s].clear();
+		_micros[s].reserve(frames);
+	}
+	if (_frames.empty()) {
+		return;
+	}
+	double micros[STAGES];
+	time_t time = 0;
+	for (int i = 0; i < warmup; i++) {
+		processFrame(_frames[i % _frames.size()], time++, micros);
+	}
+
+	_labeled = _kVCorrect = _mACorrect = 0;
+	uint64_t allocationsBefore = 0, allocationsAfter = 0;
+	bool counted = allocationCount(allocationsBefore);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < frames; i++) {
+		size_t frame = i % _frames.size();
+		processFrame(_frames[frame], time++, micros);
+		for (int s = 0; s < STAGES; s++) {
+			_micros[s].push_back(micros[s]);
+		}
+		if (!std::isnan(_truth[frame][0])) {
+			_labeled++;
+			_kVCorrect += matches(_result.kV.value, _truth[frame][0], _config.getKvRules());
+			_mACorrect += matches(_result.mA.value, _truth[frame][1], _config.getMaRules());
+		}
+	}
+	_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	// the latency vectors were reserved up front and add no allocations
+	counted = allocationCount(allocationsAfter) && counted;
+	_measured = frames;
+	_allocationsPerFrame = counted && frames > 0 ? double(allocationsAfter - allocationsBefore) / frames : -1.;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	_peakRssKb = usage.ru_maxrss;
+
+	for (int s = 0; s < STAGES; s++) {
+		std::sort(_micros[s].begin(), _micros[s].end());
+	}
+}
+
+// A stage takes what its histogram grew by during the frame, the engine observes whole microseconds.
+void Benchmark::processFrame(const cv::Mat& frame, time_t time, double* micros) {
+	const uint64_t process = _metrics.process.getSum();
+	const uint64_t recognize = _metrics.recognize.getSum();
+	const uint64_t validate = _metrics.validate.getSum();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	_result = _engine.process(frame, time);
+	micros[TOTAL] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	micros[PROCESS] = double(_metrics.process.getSum() - process);
+	micros[RECOGNIZE] = double(_metrics.recognize.getSum() - recognize);
+	micros[VALIDATE] = double(_metrics.validate.getSum() - validate);
+}
+
+// Recognized digits match the shown value to the resolution of the display.
+bool Benchmark::matches(double value, double truth, const ChannelRules& rules) {
+	return !std::isnan(value) && std::fabs(value - truth) < rules.resolution / 2.;
+}
+
+void Benchmark::report(std::ostream& os) const {
+	os << "## Benchmark: " << _measured << " frames (" << _frames.size() << " distinct), engine "
+			<< _engine.getEngineName() << " ##\n";
+	os << std::fixed << std::setprecision(1);
+	os << "throughput: " << (_seconds > 0. ? _measured / _seconds : 0.) << " frames/s\n";
+	os << std::left << std::setw(12) << "stage" << std::right << std::setw(12) << "p50 [us]" << std::setw(12)
+			<< "p99 [us]" << std::setw(12) << "max [us]" << "\n";
+	for (int s = 0; s < STAGES; s++) {
+		os << std::left << std::setw(12) << stageName(s) << std::right << std::setw(12)
+				<< percentile(_micros[s], .5) << std::setw(12) << percentile(_micros[s], .99) << std::setw(12)
+				<< (_micros[s].empty() ? 0. : _micros[s].back()) << "\n";
+	}
+	os << "peak RSS: " << _peakRssKb << " kB\n";
+	if (_allocationsPerFrame >= 0.) {
+		os << "allocations per frame: " << _allocationsPerFrame << "\n";
+	} else {
+		os << "allocations per frame: not available\n";
+	}
+	if (_labeled > 0) {
+		os << "accuracy: kV " << 100. * _kVCorrect / _labeled << " %, mA " << 100. * _mACorrect / _labeled << " % of "
+				<< _labeled << " frames with known values\n";
+	}
+}
+
+void Benchmark::writeJson(std::ostream& os) const {
+	os << std::fixed << std::setprecision(3);
+	os << "{\n";
+	os << "  \"engine\": \"" << _engine.getEngineName() << "\",\n";
+	os << "  \"frames\": " << _measured << ",\n";
+	os << "  \"distinctFrames\": " << _frames.size() << ",\n";
+	os << "  \"seconds\": " << _seconds << ",\n";
+	os << "  \"fps\": " << (_seconds > 0. ? _measured / _seconds : 0.) << ",\n";
+	os << "  \"stages\": {\n";
+	for (int s = 0; s < STAGES; s++) {
+		os << "    \"" << stageName(s) << "\": { \"p50Us\": " << percentile(_micros[s], .5) << ", \"p99Us\": "
+				<< percentile(_micros[s], .99) << ", \"maxUs\": " << (_micros[s].empty() ? 0. : _micros[s].back())
+				<< " }" << (s + 1 < STAGES ? "," : "") << "\n";
+	}
+	os << "  },\n";
+	os << "  \"peakRssKb\": " << _peakRssKb << ",\n";
+	os << "  \"allocationsPerFrame\": ";
+	if (_allocationsPerFrame >= 0.) {
+		os << _allocationsPerFrame << ",\n";
+	} else {
+		os << "null,\n";
+	}
+	os << "  \"accuracy\": ";
+	if (_labeled > 0) {
+		os << "{ \"frames\": " << _labeled << ", \"kV\": " << double(_kVCorrect) / _labeled << ", \"mA\": "
+				<< double(_mACorrect) / _labeled << " }\n";
+	} else {
+		os << "null\n";
+	}
+	os << "}\n";
+}
+
+// Nearest rank percentile of sorted values.
+double Benchmark::percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty()) {
+		return 0.;
+	}
+	size_t rank = (size_t) std::ceil(p * sorted.size());
+	return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+const char* Benchmark::stageName(int stage) {
+	switch (stage) {
+		case PROCESS: return "process";
+		case RECOGNIZE: return "recognize";
+		case VALIDATE: return "validate";
+		case TOTAL: return "total";
+	}
+	return "";
+}
@@ -0,0 +1,153 @@
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+
+#include "ChannelValidator.h"
+#include "Log.h"
+
+ChannelValidator::ChannelValidator(const std::string& name, const ChannelRules& rules, int window,
+		Metrics& metrics) :
+		_name(name), _rules(rules), _window(std::max(1, window)), _hasChecked(false),
+		_statusCounters(metrics.validationCounters(name)) {
+	if (_rules.resolution <= 0.) {
+		_rules.resolution = 1.;
+	}
+	_checked.time = 0;
+	_checked.value = -1.;
+}
+
+// Check the digits recognized for this channel.
+ChannelValidator::Status ChannelValidator::check(const std::string& digits, time_t time) {
+	Reading reading;
+	reading.time = time;
+	reading.value = 0.;
+	if (!parse(digits, _rules.resolution, reading.value)) {
+		return report(REJECTED_PARSE, reading);
+	}
+	return check(reading);
+}
+
+ChannelValidator::Status ChannelValidator::check(const Reading& reading) {
+	if (reading.value < _rules.minValue || reading.value > _rules.maxValue) {
+		return report(REJECTED_RANGE, reading);
+	}
+
+	push(reading);
+	if ((int) _values.size() > _window) {
+		pop();
+	}
+	balance();
+	if ((int) _values.size() < _window) {
+		return report(PENDING, reading);
+	}
+
+	// all values in the window must agree
+	const int maxBin = _upper.empty() ? *_lower.rbegin() : *_upper.rbegin();
+	double spread = (maxBin - *_lower.begin()) * _rules.resolution;
+	if (_rules.stableDelta > 0. && spread > _rules.stableDelta + _rules.resolution / 2) {
+		return report(REJECTED_UNSTABLE, reading);
+	}
+
+	// the median is the candidate, it must not change too fast
+	Reading candidate;
+	candidate.time = reading.time;
+	candidate.value = _rules.minValue + *_lower.rbegin() * _rules.resolution;
+	if (_hasChecked && _rules.maxRate > 0.) {
+		double dt = std::max(1., difftime(candidate.time, _checked.time));
+		if (fabs(candidate.value - _checked.value) / dt > _rules.maxRate) {
+			return report(REJECTED_RATE, candidate);
+		}
+	}
+
+	_checked = candidate;
+	_hasChecked = true;
+	return report(ACCEPTED, candidate);
+}
+
+// Convert recognized digits to a value. Without a decimal point the last digit
+// counts resolution. Fails on unrecognized characters.
+bool ChannelValidator::parse(const std::string& digits, double resolution, double& value) {
+	long mantissa = 0;
+	int decimals = -1;
+	int count = 0;
+	for (char c : digits) {
+		if (c >= '0' && c <= '9') {
+			mantissa = mantissa * 10 + (c - '0');
+			count++;
+			if (decimals >= 0) decimals++;
+		} else if (c == '.' && decimals < 0) {
+			decimals = 0;
+		} else {
+			return false;
+		}
+	}
+	if (count == 0) {
+		return false;
+	}
+	if (decimals < 0) {
+		value = mantissa * resolution;
+	} else {
+		value = mantissa / pow(10., decimals);
+	}
+	return true;
+}
+
+const char* ChannelValidator::statusName(Status status) {
+	switch (status) {
+		case ACCEPTED: return "accepted";
+		case PENDING: return "not enough values";
+		case REJECTED_PARSE: return "not a number";
+		case REJECTED_RANGE: return "out of range";
+		case REJECTED_UNSTABLE: return "unstable";
+		case REJECTED_RATE: return "changes too fast";
+	}
+	return "";
+}
+
+ChannelValidator::Status ChannelValidator::report(Status status, const Reading& reading) {
+	if (_statusCounters) {
+		_statusCounters[status].inc();
+	}
+	LOG_DEBUG(_name << " " << statusName(status) << ": " << reading.value);
+	return status;
+}
+
+int ChannelValidator::bin(double value) const {
+	return (int) lround((value - _rules.minValue) / _rules.resolution);
+}
+
+void ChannelValidator::push(const Reading& reading) {
+	int b = bin(reading.value);
+	_values.push_back(b);
+	if (_lower.empty() || b <= *_lower.rbegin()) {
+		_lower.insert(b);
+	} else {
+		_upper.insert(b);
+	}
+}
+
+void ChannelValidator::pop() {
+	int oldest = _values.front();
+	_values.pop_front();
+	// equal bins are interchangeable, take it from the half that holds one
+	if (oldest <= *_lower.rbegin()) {
+		_lower.erase(_lower.find(oldest));
+	} else {
+		_upper.erase(_upper.find(oldest));
+	}
+}
+
+// Move values between the halves until the lower one holds (n + 1) / 2 of them.
+void ChannelValidator::balance() {
+	const size_t half = (_values.size() + 1) / 2;
+	while (_lower.size() > half) {
+		std::multiset<int>::iterator last = std::prev(_lower.end());
+		_upper.insert(*last);
+		_lower.erase(last);
+	}
+	while (_lower.size() < half) {
+		_lower.insert(*_upper.begin());
+		_upper.erase(_upper.begin());
+	}
+}
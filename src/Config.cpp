@@ -1,11 +1,69 @@
-#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/core/core.hpp>
 
 #include "Config.h"
 
 Config::Config() :
         _rotationDegrees(0), _ocrMaxDist(5e5), _digitMinHeight(20), _digitMaxHeight(
                 90), _digitYAlignment(10), _cannyThreshold1(100), _cannyThreshold2(
-                200), _trainingDataFilename("trainctr.yml"), _binaryThreshold(100) {
+                200), _trainingDataFilename("trainctr.yml"), _binaryThreshold(100),
+                _ocrEngine("knn"), _segmentGeometry("standard"), _validatorWindow(5),
+                _storeDirectory("readings"), _storeBatchSize(64), _storeFsync("batch"), _storeFsyncInterval(60),
+                _recordFile("record"), _recordQueueSize(8), _recordDropPolicy("oldest"), _recordMaxMB(256),
+                _recordMaxMinutes(0), _recordKeepFiles(8), _recordRoiOnly(0),
+                _busName("/knnocr"), _busCapacity(1024),
+                _metricsPort(9464), _metricsFile("metrics.prom"),
+                _traceFile("trace.json"), _traceEvents(65536),
+                _frameIdlePeriod(2000), _frameHoldTime(5000),
+                _segmentLearnFrames(3),
+                _flightDirectory("flight"), _flightSeconds(10), _flightPostSeconds(2), _flightRoiOnly(1) {
+    ChannelRules kV = { 0., 150., 200., 1., 1. };
+    ChannelRules mA = { 0., 1000., 2000., .5, .1 };
+    _kVRules = kV;
+    _mARules = mA;
+}
+
+static void saveRules(cv::FileStorage& fs, const std::string& name, const ChannelRules& rules) {
+    fs << name << "{";
+    fs << "min" << rules.minValue;
+    fs << "max" << rules.maxValue;
+    fs << "maxRate" << rules.maxRate;
+    fs << "stableDelta" << rules.stableDelta;
+    fs << "resolution" << rules.resolution;
+    fs << "}";
+}
+
+static void loadRules(const cv::FileNode& node, ChannelRules& rules) {
+    if (node.empty()) {
+        return;
+    }
+    node["min"] >> rules.minValue;
+    node["max"] >> rules.maxValue;
+    node["maxRate"] >> rules.maxRate;
+    node["stableDelta"] >> rules.stableDelta;
+    node["resolution"] >> rules.resolution;
+}
+
+static void saveRoiBoxes(cv::FileStorage& fs, const std::vector<cv::Rect>& boxes) {
+    fs << "roiBoxes" << "[";
+    for (const cv::Rect& box : boxes) {
+        fs << "{:" << "x" << box.x << "y" << box.y << "width" << box.width << "height" << box.height << "}";
+    }
+    fs << "]";
+}
+
+static void loadRoiBoxes(const cv::FileNode& node, std::vector<cv::Rect>& boxes) {
+    if (node.empty()) {
+        return;
+    }
+    boxes.clear();
+    for (cv::FileNodeIterator it = node.begin(); it != node.end(); ++it) {
+        cv::Rect box;
+        (*it)["x"] >> box.x;
+        (*it)["y"] >> box.y;
+        (*it)["width"] >> box.width;
+        (*it)["height"] >> box.height;
+        boxes.push_back(box);
+    }
 }
 
 void Config::saveConfig() {
@@ -19,6 +77,36 @@ void Config::saveConfig() {
     fs << "ocrMaxDist" << _ocrMaxDist;
     fs << "trainingDataFilename" << _trainingDataFilename;
     fs << "binaryThreshold" << _binaryThreshold;
+    fs << "ocrEngine" << _ocrEngine;
+    fs << "segmentGeometry" << _segmentGeometry;
+    fs << "validatorWindow" << _validatorWindow;
+    saveRules(fs, "kVRules", _kVRules);
+    saveRules(fs, "mARules", _mARules);
+    fs << "storeDirectory" << _storeDirectory;
+    fs << "storeBatchSize" << _storeBatchSize;
+    fs << "storeFsync" << _storeFsync;
+    fs << "storeFsyncInterval" << _storeFsyncInterval;
+    fs << "recordFile" << _recordFile;
+    fs << "recordQueueSize" << _recordQueueSize;
+    fs << "recordDropPolicy" << _recordDropPolicy;
+    fs << "recordMaxMB" << _recordMaxMB;
+    fs << "recordMaxMinutes" << _recordMaxMinutes;
+    fs << "recordKeepFiles" << _recordKeepFiles;
+    fs << "recordRoiOnly" << _recordRoiOnly;
+    fs << "busName" << _busName;
+    fs << "busCapacity" << _busCapacity;
+    fs << "metricsPort" << _metricsPort;
+    fs << "metricsFile" << _metricsFile;
+    fs << "traceFile" << _traceFile;
+    fs << "traceEvents" << _traceEvents;
+    fs << "frameIdlePeriod" << _frameIdlePeriod;
+    fs << "frameHoldTime" << _frameHoldTime;
+    fs << "segmentLearnFrames" << _segmentLearnFrames;
+    fs << "flightDirectory" << _flightDirectory;
+    fs << "flightSeconds" << _flightSeconds;
+    fs << "flightPostSeconds" << _flightPostSeconds;
+    fs << "flightRoiOnly" << _flightRoiOnly;
+    saveRoiBoxes(fs, _roiBoxes);
     fs.release();
 }
 
@@ -34,6 +122,60 @@ void Config::loadConfig() {
         fs["ocrMaxDist"] >> _ocrMaxDist;
         fs["trainingDataFilename"] >> _trainingDataFilename;
         fs["binaryThreshold"] >> _binaryThreshold;
+        if (!fs["ocrEngine"].empty()) {
+            fs["ocrEngine"] >> _ocrEngine;
+        }
+        if (!fs["segmentGeometry"].empty()) {
+            fs["segmentGeometry"] >> _segmentGeometry;
+        }
+        if (!fs["validatorWindow"].empty()) {
+            fs["validatorWindow"] >> _validatorWindow;
+        }
+        loadRules(fs["kVRules"], _kVRules);
+        loadRules(fs["mARules"], _mARules);
+        if (!fs["storeDirectory"].empty()) {
+            fs["storeDirectory"] >> _storeDirectory;
+            fs["storeBatchSize"] >> _storeBatchSize;
+            fs["storeFsync"] >> _storeFsync;
+            fs["storeFsyncInterval"] >> _storeFsyncInterval;
+        }
+        if (!fs["recordFile"].empty()) {
+            fs["recordFile"] >> _recordFile;
+            fs["recordQueueSize"] >> _recordQueueSize;
+            fs["recordDropPolicy"] >> _recordDropPolicy;
+            fs["recordMaxMB"] >> _recordMaxMB;
+            fs["recordMaxMinutes"] >> _recordMaxMinutes;
+            if (!fs["recordKeepFiles"].empty()) {
+                fs["recordKeepFiles"] >> _recordKeepFiles;
+            }
+            fs["recordRoiOnly"] >> _recordRoiOnly;
+        }
+        if (!fs["busName"].empty()) {
+            fs["busName"] >> _busName;
+            fs["busCapacity"] >> _busCapacity;
+        }
+        if (!fs["metricsPort"].empty()) {
+            fs["metricsPort"] >> _metricsPort;
+            fs["metricsFile"] >> _metricsFile;
+        }
+        if (!fs["traceFile"].empty()) {
+            fs["traceFile"] >> _traceFile;
+            fs["traceEvents"] >> _traceEvents;
+        }
+        if (!fs["frameIdlePeriod"].empty()) {
+            fs["frameIdlePeriod"] >> _frameIdlePeriod;
+            fs["frameHoldTime"] >> _frameHoldTime;
+        }
+        if (!fs["segmentLearnFrames"].empty()) {
+            fs["segmentLearnFrames"] >> _segmentLearnFrames;
+        }
+        if (!fs["flightDirectory"].empty()) {
+            fs["flightDirectory"] >> _flightDirectory;
+            fs["flightSeconds"] >> _flightSeconds;
+            fs["flightPostSeconds"] >> _flightPostSeconds;
+            fs["flightRoiOnly"] >> _flightRoiOnly;
+        }
+        loadRoiBoxes(fs["roiBoxes"], _roiBoxes);
         fs.release();
     } else {
         // no config file - create an initial one with default values
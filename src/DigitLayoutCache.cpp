@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <climits>
+
+#include "DigitLayoutCache.h"
+
+DigitLayoutCache::DigitLayoutCache(int learnFrames, int minHeight, int maxHeight) :
+		_learnFrames(learnFrames), _minHeight(minHeight), _maxHeight(maxHeight) {
+	reset();
+}
+
+void DigitLayoutCache::reset() {
+	_fieldSize = cv::Size();
+	_cells.clear();
+	_frames = 0;
+	_outsideInk = 0;
+	_minCellInk = INT_MAX;
+	_learned = false;
+}
+
+bool DigitLayoutCache::crop(const cv::Mat& field, std::vector<cv::Rect>& boxes) {
+	if (!_learned || field.size() != _fieldSize) {
+		return false;
+	}
+	boxes.clear();
+	int cellInk = 0;
+	for (size_t i = 0; i < _cells.size(); i++) {
+		cv::Mat cell = field(_cells[i]);
+		cv::Rect bounds;
+		int ink;
+		// an empty cell or a glyph segmentation would drop means the layout changed
+		if (!inkBounds(cell, bounds, ink) || bounds.height <= _minHeight || bounds.height >= _maxHeight) {
+			return false;
+		}
+		cellInk += ink;
+		boxes.push_back(bounds + _cells[i].tl());
+	}
+	// a new digit shows up as ink outside the cells; allow half of the faintest digit
+	int outsideInk = cv::countNonZero(field) - cellInk;
+	return outsideInk <= _outsideInk + _minCellInk / 2;
+}
+
+// Digit boxes match the learned cells if they are as many and each overlaps its own cell only.
+bool DigitLayoutCache::matches(const std::vector<cv::Rect>& boxes) const {
+	if (boxes.size() != _cells.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < boxes.size(); i++) {
+		if ((boxes[i] & _cells[i]).area() == 0) {
+			return false;
+		}
+		if ((i > 0 && (boxes[i] & _cells[i - 1]).area() > 0)
+				|| (i + 1 < boxes.size() && (boxes[i] & _cells[i + 1]).area() > 0)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void DigitLayoutCache::learn(const cv::Mat& field, const std::vector<cv::Rect>& boxes) {
+	if (_learnFrames <= 0) {
+		return;
+	}
+	if (boxes.empty()) {
+		reset();
+		return;
+	}
+	// boxes that fit the cells widen them, e.g. a '1' followed by an '8', and keep a learned layout
+	if (field.size() != _fieldSize || !matches(boxes)) {
+		reset();
+		_fieldSize = field.size();
+		_cells = boxes;
+	}
+
+	int cellInk = 0;
+	for (size_t i = 0; i < boxes.size(); i++) {
+		_cells[i] |= boxes[i];
+		int ink = cv::countNonZero(field(boxes[i]));
+		cellInk += ink;
+		_minCellInk = std::min(_minCellInk, ink);
+	}
+	_outsideInk = std::max(_outsideInk, cv::countNonZero(field) - cellInk);
+	if (++_frames >= _learnFrames) {
+		_learned = true;
+	}
+}
+
+// Bounding box and pixel count of the ink in a binary cell. False if there is none.
+bool DigitLayoutCache::inkBounds(const cv::Mat& cell, cv::Rect& bounds, int& ink) {
+	int left = cell.cols, right = -1, top = cell.rows, bottom = -1;
+	ink = 0;
+	for (int y = 0; y < cell.rows; y++) {
+		const uchar* row = cell.ptr<uchar>(y);
+		int rowInk = 0;
+		for (int x = 0; x < cell.cols; x++) {
+			if (row[x]) {
+				left = std::min(left, x);
+				right = std::max(right, x);
+				rowInk++;
+			}
+		}
+		if (rowInk) {
+			top = std::min(top, y);
+			bottom = y;
+			ink += rowInk;
+		}
+	}
+	if (!ink) {
+		return false;
+	}
+	bounds = cv::Rect(left, top, right - left + 1, bottom - top + 1);
+	return true;
+}
@@ -0,0 +1,99 @@
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <opencv2/core/utility.hpp>
+
+#include "Engine.h"
+#include "SevenSegmentOcr.h"
+#include "Metrics.h"
+#include "Log.h"
+
+Engine::Engine(const Config& config, Metrics& metrics) :
+		_config(config), _metrics(metrics), _proc(config), _knn(config), _segmentOcr(createSevenSegmentOcr(config)),
+		_kVValidator("kV", config.getKvRules(), config.getValidatorWindow(), metrics),
+		_mAValidator("mA", config.getMaRules(), config.getValidatorWindow(), metrics) {
+}
+
+bool Engine::load() {
+	if (!_config.getRoiBoxes().empty()) {
+		setLayout(_config.getRoiBoxes());
+	}
+	if (_segmentOcr) {
+		return true;
+	}
+	if (!_knn.loadTrainingData()) {
+		LOG_ERROR("Failed to load OCR training data from " << _config.getTrainingDataFilename());
+		return false;
+	}
+	return true;
+}
+
+void Engine::watchModel(int intervalMs) {
+	if (!_segmentOcr) {
+		_knn.watchTrainingData(intervalMs);
+	}
+}
+
+bool Engine::setLayout(const std::vector<cv::Rect>& roiBoxes) {
+	if (roiBoxes.size() < 3) {
+		LOG_ERROR("ROI layout needs at least 3 boxes: kV, mA and power indicator last");
+		return false;
+	}
+	std::vector<cv::Rect> boxes(roiBoxes);
+	_roi.setROIBox(boxes);
+	return true;
+}
+
+bool Engine::hasLayout() const {
+	return _roi.getROIBox().size() >= 3;
+}
+
+void Engine::checkLayout() const {
+	if (!hasLayout()) {
+		throw std::runtime_error("Engine has no ROI layout");
+	}
+}
+
+FrameResult Engine::process(const cv::Mat& frame, time_t time) {
+	return process(_proc, frame, time);
+}
+
+// Image processing and recognition of a frame do not depend on the other frames, so the
+// batch is split into stripes with a processor each. The validators keep a window of the
+// past readings and see the frames in order afterwards.
+void Engine::process(const std::vector<cv::Mat>& frames, const std::vector<time_t>& times,
+		std::vector<FrameResult>& results) {
+	checkLayout();
+	if (frames.size() != times.size()) {
+		throw std::invalid_argument("Engine::process needs a time for every frame");
+	}
+	results.resize(frames.size());
+	int stripes = std::max(1, std::min((int) frames.size(), cv::getNumThreads()));
+	cv::parallel_for_(cv::Range(0, (int) frames.size()), [&](const cv::Range& range) {
+		ImageProcessor proc(_config);
+		for (int i = range.start; i < range.end; i++) {
+			Tracer::beginFrame();
+			results[i].time = times[i];
+			recognize(proc, frames[i], results[i]);
+		}
+	}, stripes);
+	for (size_t i = 0; i < results.size(); i++) {
+		validate(results[i]);
+	}
+}
+
+void Engine::validate(FrameResult& result) {
+	StageTimer timer(_metrics.validate, "validate");
+	validate(_kVValidator, _config.getKvRules(), result.time, result.kV);
+	validate(_mAValidator, _config.getMaRules(), result.time, result.mA);
+}
+
+void Engine::validate(ChannelValidator& validator, const ChannelRules& rules, time_t time, ChannelResult& result) {
+	if (!ChannelValidator::parse(result.digits, rules.resolution, result.value)) {
+		result.value = NAN;
+	}
+	result.status = validator.check(result.digits, time);
+	result.hasChecked = validator.hasCheckedValue();
+	result.checked.time = validator.getCheckedTime();
+	result.checked.value = validator.getCheckedValue();
+}
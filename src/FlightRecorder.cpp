@@ -0,0 +1,211 @@
+#include <cstdio>
+#include <cerrno>
+#include <fstream>
+#include <algorithm>
+#include <sys/stat.h>
+#include <opencv2/imgcodecs.hpp>
+
+#include "FlightRecorder.h"
+#include "Metrics.h"
+#include "Log.h"
+
+FlightRecorder::FlightRecorder(const std::string& directory, int seconds, int postSeconds, int periodMs) :
+		_directory(directory), _seconds(seconds), _postFrames(std::max(0, postSeconds) * 1000 / std::max(1, periodMs)),
+		_slots(seconds > 0 ? seconds * 1000 / std::max(1, periodMs) + 1 : 0), _next(0), _count(0), _pending(-1),
+		_sinceTrigger(0), _dump(_slots.size()), _dumpCount(0), _dumpTime(0), _dumpReady(false),
+		_running(false), _dumps(0) {
+	// the frames after the trigger must fit the ring
+	_postFrames = std::min(_postFrames, (int) _slots.size() / 2);
+}
+
+FlightRecorder::~FlightRecorder() {
+	stop();
+}
+
+void FlightRecorder::setRoi(const cv::Rect& roi) {
+	_roi = roi;
+}
+
+void FlightRecorder::start() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_running || _slots.empty()) {
+		return;
+	}
+	_running = true;
+	_thread = std::thread(&FlightRecorder::run, this);
+}
+
+// Write the dump in progress and a pending one, then end the writer thread. A pending dump
+// ends here and takes a queued follow-up trigger with it, the ring holds its frames so far.
+void FlightRecorder::stop() {
+	if (_pending >= 0) {
+		if (!_nextReason.empty()) {
+			_reason += "+" + _nextReason;
+			_nextReason.clear();
+		}
+		snapshot(true);
+	}
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_running) {
+			return;
+		}
+		_running = false;
+	}
+	_cond.notify_all();
+	_thread.join();
+}
+
+void FlightRecorder::record(const cv::Mat& frame, uint64_t frameNo, const FrameResult& result) {
+	if (_slots.empty() || frame.empty()) {
+		return;
+	}
+	const cv::Mat src = _roi.area() > 0 ? frame(_roi & cv::Rect(0, 0, frame.cols, frame.rows)) : frame;
+	if (_slots[_next].image.empty()) {
+		// first frame: allocate the ring and the dump buffer, they are swapped and reused from now on
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (size_t i = 0; i < _slots.size(); i++) {
+			_slots[i].image.create(src.size(), src.type());
+			_dump[i].image.create(src.size(), src.type());
+		}
+	}
+
+	Slot& slot = _slots[_next];
+	src.copyTo(slot.image);
+	slot.frame = frameNo;
+	slot.time = result.time;
+	slot.powerOn = result.powerOn;
+	slot.kV = result.kV.digits;
+	slot.mA = result.mA.digits;
+	slot.kVStatus = result.kV.status;
+	slot.mAStatus = result.mA.status;
+	_next = (_next + 1) % (int) _slots.size();
+	_count = std::min(_count + 1, (int) _slots.size());
+
+	if (_pending >= 0) {
+		_sinceTrigger++;
+	}
+	if (_pending > 0 && --_pending == 0) {
+		snapshot();
+		if (!_nextReason.empty()) {
+			// the ring is empty now, the next dump starts with the frames after this one
+			_reason = _nextReason;
+			_nextReason.clear();
+			_sinceTrigger = 0;
+			_pending = std::max(1, _postFrames);
+		}
+	}
+}
+
+// A dump takes the frames out of the ring, so the ring only holds frames that were not dumped yet.
+void FlightRecorder::trigger(const char* reason) {
+	if (_count == 0) {
+		return;
+	}
+	const Slot& last = _slots[(_next + _slots.size() - 1) % _slots.size()];
+	LOG_INFO("Flight recorder triggered by " << reason << " at frame " << last.frame);
+	if (_pending >= 0) {
+		// keep at least as many frames before the first trigger as after the last one
+		if (_sinceTrigger + 2 * _postFrames <= (int) _slots.size()) {
+			_pending = std::max(_pending, _postFrames);
+		} else if (_nextReason.empty()) {
+			_nextReason = reason;
+		}
+		return;
+	}
+	_reason = reason;
+	_sinceTrigger = 0;
+	if (_postFrames == 0) {
+		snapshot();
+	} else {
+		_pending = _postFrames;
+	}
+}
+
+long FlightRecorder::getDumps() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _dumps;
+}
+
+// Hand the ring over to the writer by swapping it with the dump buffer. With wait, a dump
+// still being written is waited for instead of dropping this one.
+void FlightRecorder::snapshot(bool wait) {
+	_pending = -1;
+	std::unique_lock<std::mutex> lock(_mutex);
+	// a follow-up dump stopped before its first frame has nothing to write
+	if (!_running || _count == 0) {
+		return;
+	}
+	if (wait) {
+		_cond.wait(lock, [this] { return !_dumpReady; });
+	}
+	if (_dumpReady) {
+		LOG_WARN("Flight recorder is still writing, dump of " << _reason << " dropped");
+		return;
+	}
+	const int size = (int) _slots.size();
+	const int first = (_next + size - _count) % size;
+	for (int i = 0; i < _count; i++) {
+		std::swap(_slots[(first + i) % size], _dump[i]);
+	}
+	_dumpCount = _count;
+	_dumpReason = _reason;
+	_dumpTime = _dump[_count - 1].time;
+	_count = 0;
+	_dumpReady = true;
+	_cond.notify_one();
+}
+
+// Writer thread.
+void FlightRecorder::run() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true) {
+		_cond.wait(lock, [this] { return _dumpReady || !_running; });
+		if (!_dumpReady) {
+			break;
+		}
+		// the dump buffer is ours until _dumpReady is cleared
+		lock.unlock();
+		writeDump();
+		lock.lock();
+		_dumpReady = false;
+		_dumps++;
+		// stop() may wait for the buffer
+		_cond.notify_all();
+	}
+}
+
+// One directory per dump: the frames as PNG and their readings as CSV.
+void FlightRecorder::writeDump() {
+	TraceSpan span("flightDump");
+	struct tm date;
+	char stamp[32];
+	localtime_r(&_dumpTime, &date);
+	strftime(stamp, sizeof(stamp), "/%Y%m%d-%H%M%S-", &date);
+	std::string dir = _directory + stamp + _dumpReason;
+	if ((mkdir(_directory.c_str(), 0755) != 0 && errno != EEXIST) || (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)) {
+		LOG_ERROR("Cannot create flight recorder directory " << dir);
+		return;
+	}
+
+	std::ofstream csv((dir + "/readings.csv").c_str());
+	csv << "frame,time,power,kV,kVStatus,mA,mAStatus\n";
+	int written = 0;
+	for (int i = 0; i < _dumpCount; i++) {
+		const Slot& slot = _dump[i];
+		// at the idle frame rate the ring reaches further back than the window
+		if (slot.time < _dumpTime - _seconds) {
+			continue;
+		}
+		char name[32];
+		snprintf(name, sizeof(name), "/%08llu.png", (unsigned long long) slot.frame);
+		if (cv::imwrite(dir + name, slot.image)) {
+			written++;
+		}
+		csv << slot.frame << ',' << slot.time << ',' << (slot.powerOn ? 1 : 0) << ',' << slot.kV << ','
+				<< ChannelValidator::statusName(slot.kVStatus) << ',' << slot.mA << ','
+				<< ChannelValidator::statusName(slot.mAStatus) << '\n';
+	}
+	Metrics::instance().flightDumps.inc();
+	LOG_INFO("Flight recorder wrote " << written << " frames to " << dir);
+}
@@ -0,0 +1,44 @@
+#include <thread>
+#include <algorithm>
+
+#include "FrameScheduler.h"
+#include "Metrics.h"
+#include "Log.h"
+
+FrameScheduler::FrameScheduler(int activeMs, int idleMs, int holdMs) :
+		_activePeriod(std::chrono::milliseconds(std::max(1, activeMs))),
+		_idlePeriod(std::chrono::milliseconds(std::max(activeMs, idleMs))),
+		_hold(std::chrono::milliseconds(std::max(0, holdMs))),
+		_deadline(Clock::now()), _lastActivity(_deadline), _active(true), _frames(0), _missed(0) {
+}
+
+FrameScheduler::Clock::duration FrameScheduler::next(bool powerOn, bool changed) {
+	Clock::time_point now = Clock::now();
+	_frames++;
+	if (powerOn || changed) {
+		_lastActivity = now;
+	}
+	bool active = now - _lastActivity < _hold;
+	if (active != _active) {
+		_active = active;
+		LOG_DEBUG("Frame scheduler " << (active ? "active" : "idle"));
+	}
+	Clock::duration period = active ? _activePeriod : _idlePeriod;
+	Metrics::instance().framePeriod.set(std::chrono::duration_cast<std::chrono::milliseconds>(period).count());
+
+	// the next deadline counts from the last one, not from now
+	_deadline += period;
+	if (_deadline < now) {
+		_missed++;
+		Metrics::instance().deadlinesMissed.inc();
+		LOG_WARN_EVERY(10000, "Frame missed its deadline by "
+				<< std::chrono::duration_cast<std::chrono::milliseconds>(now - _deadline).count() << " ms");
+		_deadline = now;
+	}
+	return _deadline - now;
+}
+
+void FrameScheduler::wait(bool powerOn, bool changed) {
+	next(powerOn, changed);
+	std::this_thread::sleep_until(_deadline);
+}
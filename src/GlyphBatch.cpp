@@ -0,0 +1,75 @@
+#include <cmath>
+#include <algorithm>
+
+#include "GlyphBatch.h"
+
+GlyphBatch::GlyphBatch(int capacity) :
+		_samples(std::max(1, capacity), SAMPLE_DIMS, CV_32F), _count(0) {
+	_boxes.reserve(_samples.rows);
+}
+
+void GlyphBatch::assign(const cv::Mat& field, const std::vector<cv::Rect>& boxes) {
+	if ((int) boxes.size() > _samples.rows) {
+		// more glyphs than ever before, grow once
+		_samples.create((int) boxes.size() * 2, SAMPLE_DIMS, CV_32F);
+	}
+	_field = field;
+	_boxes.assign(boxes.begin(), boxes.end());
+	_count = (int) boxes.size();
+	for (int i = 0; i < _count; i++) {
+		prepare(field(boxes[i]), _samples.ptr<float>(i));
+	}
+}
+
+void GlyphBatch::clear() {
+	_field = cv::Mat();
+	_boxes.clear();
+	_count = 0;
+}
+
+// Source positions and weights follow cv::resize: pixel centers are mapped onto each other
+// and clamped at the border. The interpolation is exact, cv::resize rounds its fixed point
+// weights, so a sample may differ from a cv::resize of the glyph by one gray level.
+void GlyphBatch::prepare(const cv::Mat& glyph, float* sample) {
+	CV_Assert(glyph.type() == CV_8UC1 && !glyph.empty());
+	int x0[SAMPLE_SIZE], x1[SAMPLE_SIZE], y0[SAMPLE_SIZE], y1[SAMPLE_SIZE];
+	float ax[SAMPLE_SIZE], ay[SAMPLE_SIZE];
+	const float scaleX = (float) glyph.cols / SAMPLE_SIZE;
+	const float scaleY = (float) glyph.rows / SAMPLE_SIZE;
+	for (int d = 0; d < SAMPLE_SIZE; d++) {
+		float fx = (d + .5f) * scaleX - .5f;
+		x0[d] = (int) std::floor(fx);
+		ax[d] = fx - x0[d];
+		if (x0[d] < 0) {
+			x0[d] = 0;
+			ax[d] = 0.f;
+		} else if (x0[d] >= glyph.cols - 1) {
+			x0[d] = glyph.cols - 1;
+			ax[d] = 0.f;
+		}
+		x1[d] = std::min(x0[d] + 1, glyph.cols - 1);
+
+		float fy = (d + .5f) * scaleY - .5f;
+		y0[d] = (int) std::floor(fy);
+		ay[d] = fy - y0[d];
+		if (y0[d] < 0) {
+			y0[d] = 0;
+			ay[d] = 0.f;
+		} else if (y0[d] >= glyph.rows - 1) {
+			y0[d] = glyph.rows - 1;
+			ay[d] = 0.f;
+		}
+		y1[d] = std::min(y0[d] + 1, glyph.rows - 1);
+	}
+
+	for (int dy = 0; dy < SAMPLE_SIZE; dy++) {
+		const uchar* top = glyph.ptr<uchar>(y0[dy]);
+		const uchar* bottom = glyph.ptr<uchar>(y1[dy]);
+		float* out = sample + dy * SAMPLE_SIZE;
+		for (int dx = 0; dx < SAMPLE_SIZE; dx++) {
+			float t = top[x0[dx]] + ax[dx] * (top[x1[dx]] - top[x0[dx]]);
+			float b = bottom[x0[dx]] + ax[dx] * (bottom[x1[dx]] - bottom[x0[dx]]);
+			out[dx] = (float) cvRound(t + ay[dy] * (b - t));
+		}
+	}
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "GlyphClusters.h"
+
+static const int TILE_WIDTH = 24;
+static const int TILE_HEIGHT = 40;
+static const int TILE_COLUMNS = 10;
+static const int TILE_GAP = 2;
+
+GlyphClusters::GlyphClusters(const Config& config, int maxGlyphs) :
+		_config(config), _maxGlyphs(maxGlyphs) {
+}
+
+bool GlyphClusters::extract(const std::vector<cv::Mat>& frames, ROIBox* roi) {
+	std::vector<std::vector<cv::Mat>> images(frames.size());
+	std::vector<cv::Mat> samples(frames.size());
+
+	// one processor per stripe, the processors keep per frame state
+	cv::parallel_for_(cv::Range(0, (int) frames.size()), [&](const cv::Range& range) {
+		ImageProcessor proc(_config);
+		proc.ocrkVmA();
+		for (int i = range.start; i < range.end; i++) {
+			cv::Mat frame = frames[i];
+			proc.setInput(frame);
+			proc.process(roi);
+			for (const GlyphBatch* glyphs : { &proc.getGlyphskV(), &proc.getGlyphsmA() }) {
+				for (int g = 0; g < glyphs->size(); g++) {
+					images[i].push_back(glyphs->glyph(g).clone());
+				}
+				samples[i].push_back(glyphs->samples());
+			}
+		}
+	});
+
+	// in frame order, so the result does not depend on the stripes
+	for (size_t i = 0; i < frames.size(); i++) {
+		for (size_t g = 0; g < images[i].size(); g++) {
+			if (_samples.rows >= _maxGlyphs) {
+				return false;
+			}
+			_samples.push_back(samples[i].row((int) g));
+			_images.push_back(images[i][g]);
+		}
+	}
+	return _samples.rows < _maxGlyphs;
+}
+
+void GlyphClusters::cluster(int k) {
+	std::vector<int> glyphs(_samples.rows);
+	for (int i = 0; i < _samples.rows; i++) {
+		glyphs[i] = i;
+	}
+	_clusters = kmeans(glyphs, k);
+}
+
+std::vector<GlyphClusters::Cluster> GlyphClusters::split(const Cluster& cluster, int k) const {
+	return kmeans(cluster.members, k);
+}
+
+std::vector<GlyphClusters::Cluster> GlyphClusters::kmeans(const std::vector<int>& glyphs, int k) const {
+	std::vector<Cluster> clusters;
+	k = std::min(k, (int) glyphs.size());
+	if (k < 1) {
+		return clusters;
+	}
+	cv::Mat data((int) glyphs.size(), _samples.cols, CV_32F);
+	for (size_t i = 0; i < glyphs.size(); i++) {
+		_samples.row(glyphs[i]).copyTo(data.row((int) i));
+	}
+	cv::Mat labels, centers;
+	cv::kmeans(data, k, labels, cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 20, 1.), 3,
+			cv::KMEANS_PP_CENTERS, centers);
+
+	std::vector<std::vector<std::pair<float, int>>> members(k);
+	for (int i = 0; i < data.rows; i++) {
+		int c = labels.at<int>(i);
+		float dist = (float) cv::norm(data.row(i), centers.row(c), cv::NORM_L2SQR);
+		members[c].push_back(std::make_pair(dist, glyphs[i]));
+	}
+	for (int c = 0; c < k; c++) {
+		if (members[c].empty()) {
+			continue;
+		}
+		std::sort(members[c].begin(), members[c].end());
+		Cluster cluster;
+		for (const std::pair<float, int>& member : members[c]) {
+			cluster.members.push_back(member.second);
+		}
+		cluster.spread = members[c].back().first;
+		clusters.push_back(cluster);
+	}
+	std::sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+		return a.members.size() > b.members.size();
+	});
+	return clusters;
+}
+
+cv::Mat GlyphClusters::getSamples(const Cluster& cluster, int maxSamples) const {
+	cv::Mat samples;
+	const int n = (int) cluster.members.size();
+	const int count = std::min(n, maxSamples);
+	for (int i = 0; i < count; i++) {
+		int member = count > 1 ? i * (n - 1) / (count - 1) : 0;
+		samples.push_back(_samples.row(cluster.members[member]));
+	}
+	return samples;
+}
+
+cv::Mat GlyphClusters::montage(const Cluster& cluster, int maxTiles) const {
+	const int n = (int) cluster.members.size();
+	const int tiles = std::min(n, maxTiles);
+	// the last row shows the farthest members if not all fit
+	const int farthest = n > tiles ? std::min(TILE_COLUMNS, tiles / 4) : 0;
+	const int rows = (tiles + TILE_COLUMNS - 1) / TILE_COLUMNS;
+	const int columns = std::min(tiles, TILE_COLUMNS);
+	cv::Mat montage(rows * (TILE_HEIGHT + TILE_GAP) + TILE_GAP, columns * (TILE_WIDTH + TILE_GAP) + TILE_GAP,
+			CV_8UC1, cv::Scalar(64));
+
+	for (int t = 0; t < tiles; t++) {
+		int member = t < tiles - farthest ? t : n - (tiles - t);
+		cv::Rect tile(TILE_GAP + (t % TILE_COLUMNS) * (TILE_WIDTH + TILE_GAP),
+				TILE_GAP + (t / TILE_COLUMNS) * (TILE_HEIGHT + TILE_GAP), TILE_WIDTH, TILE_HEIGHT);
+		cv::Mat target = montage(tile);
+		cv::resize(_images[cluster.members[member]], target, tile.size(), 0, 0, cv::INTER_NEAREST);
+		if (t >= tiles - farthest) {
+			cv::rectangle(montage, tile, cv::Scalar(128), 1);
+		}
+	}
+	return montage;
+}
@@ -4,17 +4,26 @@
  */
 
 #include <ctime>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <string>
 #include <list>
 #include <iostream>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
 
 #include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/highgui/highgui.hpp>
-
-#include <log4cpp/Category.hh>
-#include <log4cpp/Priority.hh>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
 
 #include "ImageInput.h"
+#include "Log.h"
 
 ImageInput::~ImageInput() {
 }
@@ -42,10 +51,14 @@ void ImageInput::saveImage() {
     strftime(filename, PATH_MAX, "/%Y%m%d-%H%M%S.png", &date);
     std::string path = _outDir + filename;
     if (cv::imwrite(path, _img)) {
-    	std::cout << "Image saved to " + path << std::endl;
+    	LOG_INFO("Image saved to " << path);
     }
 }
 
+std::vector<cv::Rect> ImageInput::getLayout() const {
+    return std::vector<cv::Rect>();
+}
+
 
 // Directory Input
 DirectoryInput::DirectoryInput(const Directory& directory) :
@@ -74,7 +87,7 @@ bool DirectoryInput::nextImage() {
     date.tm_sec = atoi(_itFilename->substr(13, 2).c_str());
     _time = mktime(&date);
 
-    //log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Processing " << *_itFilename << " of " << ctime(&_time);
+    LOG_DEBUG("Processing " << *_itFilename);
 
     // save copy of image if requested
     if (!_outDir.empty()) {
@@ -87,7 +100,7 @@ bool DirectoryInput::nextImage() {
 
 CameraInput::CameraInput(int device) {
     _capture.open(device);
-    std::cout << "Camera FPS: " <<_capture.get(cv::CAP_PROP_FPS) << std::endl;;
+    LOG_INFO("Camera FPS: " << _capture.get(cv::CAP_PROP_FPS));
 }
 
 bool CameraInput::nextImage() {
@@ -95,7 +108,9 @@ bool CameraInput::nextImage() {
     // read image from camera
     bool success = _capture.read(_img);
 
-    //log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Image captured: " << success;
+    if (!success) {
+        LOG_WARN_EVERY(10000, "Failed to capture image from camera");
+    }
 
     // save copy of image if requested
     if (success && !_outDir.empty()) {
@@ -105,4 +120,287 @@ bool CameraInput::nextImage() {
     return success;
 }
 
+// Video file input, e.g. a recording of the test mode.
+// Frame times count from the start of the program by the position in the video.
+VideoInput::VideoInput(const std::string& filename) {
+    if (!_capture.open(filename)) {
+        LOG_ERROR("Failed to open video " << filename);
+    }
+    time(&_startTime);
+    _time = _startTime;
+}
 
+bool VideoInput::nextImage() {
+    if (!_capture.read(_img)) {
+        return false;
+    }
+    _time = _startTime + (time_t) (_capture.get(cv::CAP_PROP_POS_MSEC) / 1000.);
+
+    // save copy of image if requested
+    if (!_outDir.empty()) {
+        saveImage();
+    }
+    return true;
+}
+
+// Hand out a frame of the source buffer. Only YUYV needs a pass, to gather the Y samples.
+bool LumaInput::setFrame(const uchar* data, int width, int height, int stride, uint32_t fourcc) {
+    if (fourcc == V4L2_PIX_FMT_GREY) {
+        _img = cv::Mat(height, width, CV_8UC1, (void*) data, stride);
+    } else if (fourcc == V4L2_PIX_FMT_YUYV) {
+        cv::Mat yuyv(height, width, CV_8UC2, (void*) data, stride);
+        cv::extractChannel(yuyv, _luma, 0);
+        _img = _luma;
+    } else {
+        return false;
+    }
+    time(&_time);
+
+    // save copy of image if requested
+    if (!_outDir.empty()) {
+        saveImage();
+    }
+    return true;
+}
+
+static std::string fourccName(uint32_t fourcc) {
+    std::string name;
+    for (int i = 0; i < 4; i++) {
+        name += (char) ((fourcc >> (8 * i)) & 0xff);
+    }
+    return name;
+}
+
+// V4L2 Input
+V4l2Input::V4l2Input(const std::string& device, int width, int height) :
+        _device(device), _fd(-1), _held(-1), _fourcc(0), _width(0), _height(0), _stride(0), _streaming(false) {
+    if (!open(width, height)) {
+        close();
+    }
+}
+
+V4l2Input::~V4l2Input() {
+    close();
+}
+
+static int xioctl(int fd, unsigned long request, void* arg) {
+    int r;
+    do {
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+bool V4l2Input::open(int width, int height) {
+    _fd = ::open(_device.c_str(), O_RDWR | O_NONBLOCK);
+    if (_fd < 0) {
+        LOG_ERROR("Failed to open " << _device << ": " << strerror(errno));
+        return false;
+    }
+    struct v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (xioctl(_fd, VIDIOC_QUERYCAP, &cap) < 0 || !(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)
+            || !(cap.capabilities & V4L2_CAP_STREAMING)) {
+        LOG_ERROR(_device << " is no V4L2 streaming capture device");
+        return false;
+    }
+    if (!negotiate(V4L2_PIX_FMT_GREY, width, height) && !negotiate(V4L2_PIX_FMT_YUYV, width, height)) {
+        LOG_ERROR(_device << " offers neither GREY nor YUYV frames");
+        return false;
+    }
+
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = 4;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(_fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2) {
+        LOG_ERROR(_device << " does not support memory mapped buffers");
+        return false;
+    }
+    for (unsigned i = 0; i < req.count; i++) {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (xioctl(_fd, VIDIOC_QUERYBUF, &buf) < 0) {
+            LOG_ERROR("Failed to query buffer " << i << " of " << _device);
+            return false;
+        }
+        Buffer buffer;
+        buffer.length = buf.length;
+        buffer.start = mmap(0, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, buf.m.offset);
+        if (buffer.start == MAP_FAILED) {
+            LOG_ERROR("Failed to map buffer " << i << " of " << _device << ": " << strerror(errno));
+            return false;
+        }
+        _buffers.push_back(buffer);
+        if (xioctl(_fd, VIDIOC_QBUF, &buf) < 0) {
+            LOG_ERROR("Failed to queue buffer " << i << " of " << _device);
+            return false;
+        }
+    }
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(_fd, VIDIOC_STREAMON, &type) < 0) {
+        LOG_ERROR("Failed to start streaming on " << _device << ": " << strerror(errno));
+        return false;
+    }
+    _streaming = true;
+    LOG_INFO("Capturing " << _width << "x" << _height << " " << fourccName(_fourcc) << " from " << _device
+            << " into " << _buffers.size() << " mapped buffers");
+    return true;
+}
+
+// Ask for a pixel format, keeping the current size unless one is given. Drivers adjust
+// what they cannot do, so check what was set.
+bool V4l2Input::negotiate(uint32_t fourcc, int width, int height) {
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(_fd, VIDIOC_G_FMT, &fmt) < 0) {
+        return false;
+    }
+    fmt.fmt.pix.pixelformat = fourcc;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (width > 0 && height > 0) {
+        fmt.fmt.pix.width = width;
+        fmt.fmt.pix.height = height;
+    }
+    if (xioctl(_fd, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != fourcc) {
+        return false;
+    }
+    _fourcc = fourcc;
+    _width = fmt.fmt.pix.width;
+    _height = fmt.fmt.pix.height;
+    _stride = fmt.fmt.pix.bytesperline;
+    if (_stride == 0) {
+        _stride = _width * (fourcc == V4L2_PIX_FMT_YUYV ? 2 : 1);
+    }
+    return true;
+}
+
+void V4l2Input::close() {
+    if (_streaming) {
+        enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(_fd, VIDIOC_STREAMOFF, &type);
+        _streaming = false;
+    }
+    // the current image may point into a buffer
+    _img.release();
+    for (size_t i = 0; i < _buffers.size(); i++) {
+        munmap(_buffers[i].start, _buffers[i].length);
+    }
+    _buffers.clear();
+    _held = -1;
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+void V4l2Input::requeue(int index) {
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    if (xioctl(_fd, VIDIOC_QBUF, &buf) < 0) {
+        LOG_WARN_EVERY(10000, "Failed to requeue a buffer of " << _device << ": " << strerror(errno));
+    }
+}
+
+// The held buffer goes back to the driver only once a new frame replaced it, so after
+// a failed capture the last image stays valid, as with CameraInput.
+bool V4l2Input::nextImage() {
+    if (!_streaming) {
+        return false;
+    }
+
+    struct pollfd pfd = { _fd, POLLIN, 0 };
+    int ready;
+    do {
+        ready = poll(&pfd, 1, 2000);
+    } while (ready < 0 && errno == EINTR);
+    if (ready <= 0) {
+        LOG_WARN_EVERY(10000, "Failed to capture image from " << _device << (ready == 0 ? ": timeout" : ""));
+        return false;
+    }
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(_fd, VIDIOC_DQBUF, &buf) < 0) {
+        LOG_WARN_EVERY(10000, "Failed to capture image from " << _device << ": " << strerror(errno));
+        return false;
+    }
+    if (buf.bytesused < (unsigned) _stride * _height
+            || !setFrame((const uchar*) _buffers[buf.index].start, _width, _height, _stride, _fourcc)) {
+        LOG_WARN_EVERY(10000, "Short frame from " << _device << ": " << buf.bytesused << " bytes");
+        requeue(buf.index);
+        return false;
+    }
+    if (_held >= 0) {
+        requeue(_held);
+    }
+    _held = buf.index;
+    return true;
+}
+
+// Raw File Input
+RawFileInput::RawFileInput(const std::string& filename, int width, int height, uint32_t fourcc) :
+        _filename(filename), _data(0), _size(0), _next(0), _width(width), _height(height), _fourcc(fourcc) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Failed to open " << filename << ": " << strerror(errno));
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            _data = (const uchar*) data;
+            _size = st.st_size;
+        }
+    }
+    ::close(fd);
+    if (!_data) {
+        LOG_ERROR("Failed to map " << filename);
+    } else {
+        LOG_INFO("Reading " << _size / ((size_t) width * height * (fourcc == V4L2_PIX_FMT_YUYV ? 2 : 1)) << " "
+                << width << "x" << height << " " << fourccName(fourcc) << " frames from " << filename);
+    }
+}
+
+RawFileInput::~RawFileInput() {
+    _img.release();
+    if (_data) {
+        munmap((void*) _data, _size);
+    }
+}
+
+bool RawFileInput::nextImage() {
+    int stride = _width * (_fourcc == V4L2_PIX_FMT_YUYV ? 2 : 1);
+    size_t frameBytes = (size_t) stride * _height;
+    if (!_data || frameBytes == 0 || _next + frameBytes > _size) {
+        return false;
+    }
+    const uchar* frame = _data + _next;
+    _next += frameBytes;
+    return setFrame(frame, _width, _height, stride, _fourcc);
+}
+
+ImageInput* createLumaInput(const std::string& spec) {
+    size_t colon = spec.rfind(':');
+    int width = 0, height = 0;
+    if (colon != std::string::npos && sscanf(spec.c_str() + colon + 1, "%dx%d", &width, &height) == 2
+            && width > 0 && height > 0) {
+        std::string filename = spec.substr(0, colon);
+        bool yuyv = filename.size() > 5 && filename.compare(filename.size() - 5, 5, ".yuyv") == 0;
+        return new RawFileInput(filename, width, height, yuyv ? V4L2_PIX_FMT_YUYV : V4L2_PIX_FMT_GREY);
+    }
+    if (colon != std::string::npos) {
+        return 0;
+    }
+    return new V4l2Input(spec);
+}
@@ -1,11 +1,29 @@
 #include "ImageProcessor.h"
 #include "Config.h"
+#include "Metrics.h"
+#include "Log.h"
 
 #include <vector>
 #include <iostream>
 
-#include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#ifndef KNNOCR_NO_HIGHGUI
+#include <opencv2/highgui/highgui.hpp>
+#endif
+
+#ifndef KNNOCR_NO_HIGHGUI
+void WindowDebugView::open(const char* name) {
+	cv::namedWindow(name);
+}
+
+void WindowDebugView::show(const char* name, const cv::Mat& img) {
+	cv::imshow(name, img);
+}
+
+int WindowDebugView::waitKey(int delayMs) {
+	return cv::waitKey(delayMs);
+}
+#endif
 
 class sortRectByX {
 public:
@@ -17,43 +35,74 @@ public:
 	bool operator()(cv::Rect const& a, cv::Rect const& b) const {return a.y < b.y;	}
 };
 
-ImageProcessor::ImageProcessor(const Config& config) :
+template<class DebugView>
+BasicImageProcessor<DebugView>::BasicImageProcessor(const Config& config) :
 		_config(config), _debugWindow(false), _debugSkew(false), _debugDigits(false), _debugEdges(false),
-		_key(0), powerOn(false), _ocrkVmA(false), _debugPower(false), _debugOCR(false) {
-	ofs.open("test1.txt");
+		_key(0), powerOn(false), _ocrkVmA(false), _debugPower(false), _debugOCR(false),
+		_kVLayout(config.getSegmentLearnFrames(), config.getDigitMinHeight(), config.getDigitMaxHeight()),
+		_mALayout(config.getSegmentLearnFrames(), config.getDigitMinHeight(), config.getDigitMaxHeight()) {
 }
 
-void ImageProcessor::setInput(cv::Mat& img) { _img = img; }
+template<class DebugView>
+void BasicImageProcessor<DebugView>::setInput(cv::Mat& img) { _img = img; }
 
-const std::vector<cv::Mat>& ImageProcessor::getOutput() { return _digits; }
-const std::vector<cv::Mat>& ImageProcessor::getOutputkV() { return _digits_kV; }
-const std::vector<cv::Mat>& ImageProcessor::getOutputmA() { return _digits_mA; }
+template<class DebugView>
+const std::vector<cv::Mat>& BasicImageProcessor<DebugView>::getOutput() { return _digits; }
+template<class DebugView>
+const std::vector<cv::Mat>& BasicImageProcessor<DebugView>::getOutputkV() {
+	_digits_kV.clear();
+	for (int i = 0; i < _kVGlyphs.size(); i++) {
+		_digits_kV.push_back(_kVGlyphs.glyph(i));
+	}
+	return _digits_kV;
+}
+template<class DebugView>
+const std::vector<cv::Mat>& BasicImageProcessor<DebugView>::getOutputmA() {
+	_digits_mA.clear();
+	for (int i = 0; i < _mAGlyphs.size(); i++) {
+		_digits_mA.push_back(_mAGlyphs.glyph(i));
+	}
+	return _digits_mA;
+}
 
-void ImageProcessor::debugWindow(bool bval) {
-	_debugWindow = bval;
+template<class DebugView>
+void BasicImageProcessor<DebugView>::debugWindow(bool bval) {
+	_debugWindow = DebugView::enabled && bval;
 	if(_debugWindow) {
-		cv::namedWindow("ImageProcessor");
+		DebugView::open("ImageProcessor");
 	}
 }
-void ImageProcessor::debugSkew(bool bval) { _debugSkew = bval; }
-void ImageProcessor::debugEdges(bool bval) { _debugEdges = bval; }
-void ImageProcessor::debugDigits(bool bval) { _debugDigits = bval; }
-void ImageProcessor::debugPower(bool bval) { _debugPower = bval; }
-void ImageProcessor::debugOCR(bool bval) { _debugOCR = bval; }
-void ImageProcessor::ocrkVmA(bool bval) { _ocrkVmA = bval; }
-
-int ImageProcessor::showImage() {
-	cv::imshow("ImageProcessor", _img);
-	_key = cv::waitKey(1);
+template<class DebugView>
+void BasicImageProcessor<DebugView>::debugSkew(bool bval) { _debugSkew = bval; }
+template<class DebugView>
+void BasicImageProcessor<DebugView>::debugEdges(bool bval) { _debugEdges = bval; }
+template<class DebugView>
+void BasicImageProcessor<DebugView>::debugDigits(bool bval) { _debugDigits = bval; }
+template<class DebugView>
+void BasicImageProcessor<DebugView>::debugPower(bool bval) { _debugPower = bval; }
+template<class DebugView>
+void BasicImageProcessor<DebugView>::debugOCR(bool bval) { _debugOCR = bval; }
+template<class DebugView>
+void BasicImageProcessor<DebugView>::ocrkVmA(bool bval) { _ocrkVmA = bval; }
+
+template<class DebugView>
+int BasicImageProcessor<DebugView>::showImage() {
+	DebugView::show("ImageProcessor", _img);
+	_key = DebugView::waitKey(1);
 
 	return _key;
 }
 
-void ImageProcessor::process() {
+template<class DebugView>
+void BasicImageProcessor<DebugView>::process() {
 	_digits.clear();
 
-	// convert to gray
-	cvtColor(_img, _imgGray, cv::COLOR_BGR2GRAY);
+	// convert to gray, luma inputs are gray already
+	if (_img.channels() == 1) {
+		_imgGray = _img;
+	} else {
+		cvtColor(_img, _imgGray, cv::COLOR_BGR2GRAY);
+	}
 
 	// initial rotation to get the digits up
 	rotate(_config.getRotationDegrees());
@@ -67,51 +116,67 @@ void ImageProcessor::process() {
 	// find and isolate counter digits
 	findCounterDigits();
 
-	if (_debugWindow) {
+	if (DebugView::enabled && _debugWindow) {
 		showImage();
 	}
 }
 
-bool ImageProcessor::process(ROIBox* roi)
+template<class DebugView>
+bool BasicImageProcessor<DebugView>::process(ROIBox* roi)
 {
 	_digits.clear();
-	_digits_kV.clear();
-	_digits_mA.clear();
+	_kVGlyphs.clear();
+	_mAGlyphs.clear();
+
+	// convert to gray, luma inputs are gray already
+	if (_img.channels() == 1) {
+		_imgGray = _img;
+	} else {
+		cvtColor(_img, _imgGray, cv::COLOR_BGR2GRAY);
+	}
 
-	// convert to gray
-	cvtColor(_img, _imgGray, cv::COLOR_BGR2GRAY);
+	{
+		TraceSpan span("rotate");
+		// initial rotation to get the digits up
+		rotate(_config.getRotationDegrees());
 
-	// initial rotation to get the digits up
-	rotate(_config.getRotationDegrees());
-
-	// detect and correct remaining skew (+- 30 deg)
-	if (_debugSkew) {
-		float skew_deg = detectSkew();
-		rotate(skew_deg);
+		// detect and correct remaining skew (+- 30 deg)
+		if (_debugSkew) {
+			float skew_deg = detectSkew();
+			rotate(skew_deg);
+		}
 	}
 
 	// find and isolate counter digits
-	findCounterDigits(roi);
+	{
+		StageTimer timer(Metrics::instance().segment, "findCounterDigits");
+		findCounterDigits(roi);
+	}
 
-	if (_debugWindow) {
+	if (DebugView::enabled && _debugWindow) {
 		showImage();
 	}
 
 	return powerOn;
 }
 
-void ImageProcessor::rotate(double rotationDegrees) {
+template<class DebugView>
+void BasicImageProcessor<DebugView>::rotate(double rotationDegrees) {
+	if (rotationDegrees == 0.) {
+		return;
+	}
 	cv::Mat M = cv::getRotationMatrix2D(cv::Point(_imgGray.cols/2, _imgGray.rows/2), rotationDegrees, 1);
 	cv::Mat img_rotated;
 	cv::warpAffine(_imgGray, img_rotated, M, _imgGray.size());
 	_imgGray = img_rotated;
-	if (_debugWindow) {
+	if (DebugView::enabled && _debugWindow) {
 		cv::warpAffine(_img, img_rotated, M, _img.size());
 		_img = img_rotated;
 	}
 }
 
-void ImageProcessor::drawLines(std::vector<cv::Vec2f>& lines) {
+template<class DebugView>
+void BasicImageProcessor<DebugView>::drawLines(std::vector<cv::Vec2f>& lines) {
 	// draw lines
 	for (size_t i = 0; i < lines.size(); i++) {
 		float rho = lines[i][0];
@@ -124,7 +189,8 @@ void ImageProcessor::drawLines(std::vector<cv::Vec2f>& lines) {
 	}
 }
 
-float ImageProcessor::detectSkew() {
+template<class DebugView>
+float BasicImageProcessor<DebugView>::detectSkew() {
 	cv::Mat edges = cannyEdges();
 
 	// find lines
@@ -147,29 +213,32 @@ float ImageProcessor::detectSkew() {
 	if (filteredLines.size() > 0) {
 		theta_avr /= filteredLines.size();
 		theta_deg = (theta_avr / CV_PI * 180.f) - 90;
-		//printf("detectSkew: %.1f deg", theta_deg);
-	} else { std::cout << "failed to detect skew" << std::endl; }
+		LOG_DEBUG("detectSkew: " << theta_deg << " deg");
+	} else { LOG_WARN_EVERY(10000, "failed to detect skew"); }
 
-	if (_debugSkew)
+	if (DebugView::enabled && _debugSkew)
 		drawLines(filteredLines);
 
 	return theta_deg;
 }
 
-cv::Mat ImageProcessor::cannyEdges() {
+template<class DebugView>
+cv::Mat BasicImageProcessor<DebugView>::cannyEdges() {
 	cv::Mat edges;
 	//detect edges
 	cv::Canny(_imgGray, edges, _config.getCannyThreshold1(), _config.getCannyThreshold2());
 	return edges;
 }
 
-cv::Mat ImageProcessor::binaryFiltering() {
+template<class DebugView>
+cv::Mat BasicImageProcessor<DebugView>::binaryFiltering() {
 	cv::Mat bin;
 	cv::threshold(_imgGray, bin, _config.getBinaryThreshold(), 255, cv::THRESH_BINARY);
 	return bin;
 }
 
-void ImageProcessor::findAlignedBoxes(std::vector<cv::Rect>::const_iterator begin,
+template<class DebugView>
+void BasicImageProcessor<DebugView>::findAlignedBoxes(std::vector<cv::Rect>::const_iterator begin,
 		std::vector<cv::Rect>::const_iterator end, std::vector<cv::Rect>& result) {
 	std::vector<cv::Rect>::const_iterator it = begin;
 
@@ -184,7 +253,8 @@ void ImageProcessor::findAlignedBoxes(std::vector<cv::Rect>::const_iterator begi
 	}
 }
 
-void ImageProcessor::filterContours(std::vector<std::vector<cv::Point> >& contours,
+template<class DebugView>
+void BasicImageProcessor<DebugView>::filterContours(std::vector<std::vector<cv::Point> >& contours,
         std::vector<cv::Rect>& boundingBoxes, std::vector<std::vector<cv::Point> >& filteredContours) {
 	// filter contours by bounding rect size
 	for (size_t i=0; i<contours.size(); i++) {
@@ -196,12 +266,13 @@ void ImageProcessor::filterContours(std::vector<std::vector<cv::Point> >& contou
 	}
 }
 
-void ImageProcessor::findCounterDigits() {
+template<class DebugView>
+void BasicImageProcessor<DebugView>::findCounterDigits() {
 	// edge image
 //	cv::Mat edges = cannyEdges();
 	cv::Mat edges = binaryFiltering();
-	if (_debugEdges) {
-		cv::imshow("edges", edges);
+	if (DebugView::enabled && _debugEdges) {
+		DebugView::show("edges", edges);
 	}
 	cv::Mat edges_resize;
 	//cv::resize(edges, edges_resize, cv::Size(edges.rows*2, e*resize_factor), 0, 0, INTER_LINEAR);
@@ -232,28 +303,29 @@ void ImageProcessor::findCounterDigits() {
     // sort bounding boxes from bottom to top
     std::sort(alignedBoundingBoxes.begin(), alignedBoundingBoxes.end(), sortRectByY());
 
-    if (_debugEdges) {
+    if (DebugView::enabled && _debugEdges) {
         // draw contours
         cv::Mat cont = cv::Mat::zeros(edges.rows, edges.cols, CV_8UC1);
         cv::drawContours(cont, filteredContours, -1, cv::Scalar(255));
-        cv::imshow("contours", cont);
+        DebugView::show("contours", cont);
     }
 
     // cut out found rectangles from edged image
     for (int i = 0; i < alignedBoundingBoxes.size(); ++i) {
         cv::Rect roi = alignedBoundingBoxes[i];
         _digits.push_back(img_ret(roi));
-        if (_debugDigits) {
+        if (DebugView::enabled && _debugDigits) {
             cv::rectangle(_img, roi, cv::Scalar(0, 255, 0), 2);
         }
     }
 }
 
-void ImageProcessor::findCounterDigits(ROIBox* _roi)
+template<class DebugView>
+void BasicImageProcessor<DebugView>::findCounterDigits(ROIBox* _roi)
 {
 	cv::Mat edges = binaryFiltering();
-	if (_debugEdges) {
-		cv::imshow("edges", edges);
+	if (DebugView::enabled && _debugEdges) {
+		DebugView::show("edges", edges);
 	}
 
 
@@ -272,75 +344,88 @@ void ImageProcessor::findCounterDigits(ROIBox* _roi)
 		}
 	}
 
-	cv::Mat img_ret = edges.clone();
-
-	// find contours in whole image
-	std::vector<std::vector<cv::Point>> contours, filteredContours;
-	std::vector<cv::Rect>boundingBoxes;
-	cv::findContours(edges, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
-
-	//filter contours by bounding rect size
-	filterContours(contours, boundingBoxes, filteredContours);
-
-//	// find bounding boxes that are aligned at y position
-//	std::vector<cv::Rect> alignedBoundingBoxes, tmpRes;
-//	for (std::vector<cv::Rect>::const_iterator ib = boundingBoxes.begin(); ib != boundingBoxes.end(); ++ib) {
-//		tmpRes.clear();
-//		findAlignedBoxes(ib, boundingBoxes.end(), tmpRes);
-//		if (tmpRes.size() > alignedBoundingBoxes.size()) {
-//			alignedBoundingBoxes = tmpRes;
-//		}
-//	}
-
-	// sort bounding boxes from left to right
-	std::sort(boundingBoxes.begin(), boundingBoxes.end(), sortRectByX());
-
-
-	if (_debugEdges) {
-		// draw contours
-		cv::Mat cont = cv::Mat::zeros(edges.rows, edges.cols, CV_8UC1);
-		cv::drawContours(cont, contours, -1, cv::Scalar(255));
-		cv::imshow("contours", cont);
-	}
+	// the digits of the whole image are only needed for learning and the debug views
+	bool wholeImage = !_ocrkVmA || (DebugView::enabled && (_debugEdges || _debugDigits));
+	if (wholeImage) {
+		cv::Mat img_ret = edges.clone();
+
+		// find contours in whole image
+		std::vector<std::vector<cv::Point>> contours, filteredContours;
+		std::vector<cv::Rect>boundingBoxes;
+		cv::findContours(edges, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+
+		//filter contours by bounding rect size
+		filterContours(contours, boundingBoxes, filteredContours);
+
+	//	// find bounding boxes that are aligned at y position
+	//	std::vector<cv::Rect> alignedBoundingBoxes, tmpRes;
+	//	for (std::vector<cv::Rect>::const_iterator ib = boundingBoxes.begin(); ib != boundingBoxes.end(); ++ib) {
+	//		tmpRes.clear();
+	//		findAlignedBoxes(ib, boundingBoxes.end(), tmpRes);
+	//		if (tmpRes.size() > alignedBoundingBoxes.size()) {
+	//			alignedBoundingBoxes = tmpRes;
+	//		}
+	//	}
+
+		// sort bounding boxes from left to right
+		std::sort(boundingBoxes.begin(), boundingBoxes.end(), sortRectByX());
+
+
+		if (DebugView::enabled && _debugEdges) {
+			// draw contours
+			cv::Mat cont = cv::Mat::zeros(edges.rows, edges.cols, CV_8UC1);
+			cv::drawContours(cont, contours, -1, cv::Scalar(255));
+			DebugView::show("contours", cont);
+		}
 
 
-	// cut out found rectangles from edged image
-//	std::cout << boundingBoxes.size() << std::endl;
-	for (int i = 0; i < boundingBoxes.size(); ++i) {
-		cv::Rect roi = boundingBoxes[i];
-		_digits.push_back(img_ret(roi));
+		// cut out found rectangles from edged image
+	//	std::cout << boundingBoxes.size() << std::endl;
+		for (int i = 0; i < boundingBoxes.size(); ++i) {
+			cv::Rect roi = boundingBoxes[i];
+			_digits.push_back(img_ret(roi));
 
-		if (_debugDigits) {
-			cv::rectangle(_img, roi, cv::Scalar(0, 255, 0), 1);
+			if (DebugView::enabled && _debugDigits) {
+				cv::rectangle(_img, roi, cv::Scalar(0, 255, 0), 1);
+			}
+			LOG_DEBUG("digit " << i << ": " << roi);
 		}
-		ofs << _digits[i] << std::endl;
 	}
 
 
 	if (_ocrkVmA) {
-		cv::Mat voltScreen  = edges(_roi->getROIBox()[0]);
-		cv::Mat currScreen  = edges(_roi->getROIBox()[1]);
-
-		std::vector<std::vector<cv::Point>> kVcontours, kVfilteredContours;
-		std::vector<cv::Rect> kVboundingBoxes;
-		cv::findContours(voltScreen, kVcontours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
-		filterContours(kVcontours, kVboundingBoxes, kVfilteredContours);
-		std::sort(kVboundingBoxes.begin(), kVboundingBoxes.end(), sortRectByX());
-
-		for (int i=0; i < kVboundingBoxes.size(); ++i) {
-			cv::Rect kVroi = kVboundingBoxes[i];
-			_digits_kV.push_back(voltScreen(kVroi));
-		}
-
-		std::vector<std::vector<cv::Point>> mAcontours, mAfilteredContours;
-		std::vector<cv::Rect> mAboundingBoxes;
-		cv::findContours(currScreen, mAcontours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
-		filterContours(mAcontours, mAboundingBoxes, mAfilteredContours);
-		std::sort(mAboundingBoxes.begin(), mAboundingBoxes.end(), sortRectByX());
+		segmentField(edges(_roi->getROIBox()[0]), _kVLayout, _kVGlyphs);
+		segmentField(edges(_roi->getROIBox()[1]), _mALayout, _mAGlyphs);
+	}
+}
 
-		for (int i=0; i < mAboundingBoxes.size(); ++i) {
-			cv::Rect mAroi = mAboundingBoxes[i];
-			_digits_mA.push_back(currScreen(mAroi));
-		}
+// Glyphs of a display field, cropped with the learned cells while the ink check passes,
+// otherwise segmented from the contours and learned.
+template<class DebugView>
+void BasicImageProcessor<DebugView>::segmentField(const cv::Mat& field, DigitLayoutCache& layout,
+		GlyphBatch& glyphs) {
+	Metrics& metrics = Metrics::instance();
+	if (layout.crop(field, _glyphBoxes)) {
+		metrics.segmentCacheHits.inc();
+		glyphs.assign(field, _glyphBoxes);
+		return;
+	}
+	if (layout.isLearned()) {
+		metrics.segmentCheckFailures.inc();
+		LOG_DEBUG("digit layout check failed, segmenting the field");
 	}
+
+	std::vector<std::vector<cv::Point>> contours, filteredContours;
+	_glyphBoxes.clear();
+	cv::findContours(field, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+	filterContours(contours, _glyphBoxes, filteredContours);
+	std::sort(_glyphBoxes.begin(), _glyphBoxes.end(), sortRectByX());
+
+	glyphs.assign(field, _glyphBoxes);
+	layout.learn(field, _glyphBoxes);
 }
+
+template class BasicImageProcessor<NoDebugView>;
+#ifndef KNNOCR_NO_HIGHGUI
+template class BasicImageProcessor<WindowDebugView>;
+#endif
@@ -1,140 +1,448 @@
-#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/features2d/features2d.hpp>
 #include <opencv2/ml/ml.hpp>
 
 #include <exception>
 #include <fstream>
 #include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <sys/stat.h>
 
 #include "KNearestOcr.h"
+#include "Metrics.h"
+#include "Log.h"
+
+KNearestOcr::Model::Model(int capacity) :
+		samples(capacity, 100, CV_32F), responses(capacity, 1, CV_32F), count(0) {
+}
 
 KNearestOcr::KNearestOcr(const Config& config) :
-_pModel(), _config(config) {
-	ofs.open("test.txt");
+_modelGeneration(0), _generation(0), _config(config), _watching(false), _reloadPending(false), _saves(0) {
+	memset(&_seen, 0, sizeof(_seen));
 }
 
 KNearestOcr::~KNearestOcr() {
+	if (_watcher.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(_watchMutex);
+			_watching = false;
+		}
+		_watchCond.notify_all();
+		_watcher.join();
+	}
 }
 
 
-// Learn a single digit.
-int KNearestOcr::learn(const cv::Mat& img) {
-	cv::imshow("Learn", img);
-	int key = cv::waitKey(0) & 255;
-	if (key >= 176 && key <= 185) {
-		key -= 128; // numeric keypad
+// Learn labeled digit crops without user interaction.
+// Crops are loaded and prepared in parallel. Replaces the current training data
+// unless merge is set. Returns the number of samples learned.
+int KNearestOcr::learn(const TrainingSet& trainingSet, bool merge) {
+	const int count = (int) trainingSet.size();
+	cv::Mat samples(count, 100, CV_32F);
+	cv::Mat responses(count, 1, CV_32F);
+	std::vector<uchar> valid(count, 0);
+
+	cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range) {
+		for (int i = range.start; i < range.end; i++) {
+			cv::Mat img = cv::imread(trainingSet.getFile(i), cv::IMREAD_GRAYSCALE);
+			if (img.empty()) {
+				continue;
+			}
+			cv::threshold(img, img, _config.getBinaryThreshold(), 255, cv::THRESH_BINARY);
+			prepareSample(img).copyTo(samples.row(i));
+			responses.at<float>(i, 0) = (float) trainingSet.getLabel(i) - '0';
+			valid[i] = 1;
+		}
+	});
+
+	cv::Mat learnedSamples, learnedResponses;
+	for (int i = 0; i < count; i++) {
+		if (!valid[i]) {
+			LOG_ERROR("Failed to read " << trainingSet.getFile(i));
+			continue;
+		}
+		learnedSamples.push_back(samples.row(i));
+		learnedResponses.push_back(responses.row(i));
 	}
-	if ((key >= '0' && key <= '9') || key == '.') {
-		_responses.push_back(cv::Mat(1, 1, CV_32F, (float) key - '0'));
-		_samples.push_back(prepareSample(img));
-		std::cout << char(key) << std::flush;
+	// a replacement is published complete, recognition never sees an empty model in between
+	appendSamples(learnedSamples, learnedResponses, !merge);
+	return learnedSamples.rows;
+}
+
+// Add a labeled digit to the model. The sample is visible to the next recognize() call.
+// Returns the index of the new sample.
+int KNearestOcr::addSample(const cv::Mat& img, char label) {
+	return appendSamples(prepareSample(img), cv::Mat(1, 1, CV_32F, cv::Scalar((float) label - '0')));
+}
+
+// Add prepared samples of one label, e.g. of a labeled glyph cluster. Returns the index of the first one.
+int KNearestOcr::addSamples(const cv::Mat& samples, char label) {
+	return appendSamples(samples, cv::Mat(samples.rows, 1, CV_32F, cv::Scalar((float) label - '0')));
+}
+
+// Remove a sample from the model.
+// Rows of a published snapshot never change, so this publishes a copy without the sample.
+bool KNearestOcr::removeSample(int index) {
+	std::lock_guard<std::mutex> lock(_writeMutex);
+	std::shared_ptr<Model> model = currentModel();
+	if (!model || index < 0 || index >= model->count.load(std::memory_order_acquire)) {
+		return false;
 	}
-	return key;
+	publishModel(copyModel(*model, model->samples.rows, index));
+	return true;
 }
 
-// Learn a vector of digits.
-int KNearestOcr::learn(const std::vector<cv::Mat>& images) {
-//	for (auto itr:images)
-//		ofs << itr << std::endl;
-	int key = 0;
-	for (std::vector<cv::Mat>::const_iterator it = images.begin();
-			it < images.end() && key != 's' && key != 'q'; ++it) {
-		key = learn(*it);
+// Remove the sample that is nearest to a digit, e.g. the one that caused a misread.
+// Returns the index of the removed sample or -1.
+int KNearestOcr::removeNearest(const cv::Mat& img) {
+	Neighbor nearest;
+	cv::Mat sample = prepareSample(img);
+	if (findNearest(getSamples(), getResponses(), sample.ptr<float>(0), 1, FLT_MAX, &nearest) == 0) {
+		return -1;
 	}
-	return key;
+	removeSample(nearest.index);
+	return nearest.index;
+}
+
+int KNearestOcr::getSampleCount() const {
+	std::shared_ptr<Model> model = currentModel();
+	return model ? model->count.load(std::memory_order_acquire) : 0;
+}
+
+// Valid rows of the current snapshot.
+cv::Mat KNearestOcr::getSamples() const {
+	std::shared_ptr<Model> model = currentModel();
+	return model ? model->samples.rowRange(0, model->count.load(std::memory_order_acquire)) : cv::Mat();
+}
+
+cv::Mat KNearestOcr::getResponses() const {
+	std::shared_ptr<Model> model = currentModel();
+	return model ? model->responses.rowRange(0, model->count.load(std::memory_order_acquire)) : cv::Mat();
 }
 
 bool KNearestOcr::hasTrainingData() {
-	return !_samples.empty() && !_responses.empty();
+	return getSampleCount() > 0;
 }
 
 // Save training data to file.
+// The data is written to a temporary file first, so a watching process never reads a partial file.
+// Our own watcher takes note of the new file and does not reload it: samples added after the
+// save would be lost if the saved snapshot replaced the current one.
 void KNearestOcr::saveTrainingData() {
-	cv::FileStorage fs(_config.getTrainingDataFilename(), cv::FileStorage::WRITE);
-	fs << "samples" << _samples;
-	fs << "responses" << _responses;
+	std::string filename = _config.getTrainingDataFilename();
+	std::string tmpFilename = filename + ".tmp";
+	cv::FileStorage fs(tmpFilename, cv::FileStorage::WRITE | cv::FileStorage::FORMAT_YAML);
+	fs << "samples" << getSamples();
+	fs << "responses" << getResponses();
 	fs.release();
+	if (rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+		LOG_ERROR("Failed to save training data to " << filename);
+		return;
+	}
+	std::lock_guard<std::mutex> lock(_watchMutex);
+	stat(filename.c_str(), &_seen);
+	_reloadPending = false;
+	_saves++;
 }
 
 // Load training data from file and init model.
 bool KNearestOcr::loadTrainingData() {
-	cv::FileStorage fs(_config.getTrainingDataFilename(), cv::FileStorage::READ);
-	if (fs.isOpened()) {
-		fs["samples"] >> _samples;
-		fs["responses"] >> _responses;
-		fs.release();
-
-		initModel();
-	} else return false;
+	std::shared_ptr<Model> model = loadModel(_config.getTrainingDataFilename());
+	if (!model) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(_writeMutex);
+	publishModel(model);
 	return true;
 }
 
+// Reload the training data in the background whenever the file changes.
+// Recognitions in flight finish on the snapshot they started with.
+void KNearestOcr::watchTrainingData(int intervalMs) {
+	if (_watcher.joinable()) {
+		return;
+	}
+	_watching = true;
+	_watcher = std::thread(&KNearestOcr::watch, this, intervalMs);
+}
+
 // Recognize a single digit.
-char KNearestOcr::recognize(const cv::Mat& img) {
-	char cres = '?';
-	int k_idx(3);
+char KNearestOcr::recognize(const cv::Mat& img, float* confidence) {
+	// hold the snapshot until the recognition is done, a reload may publish a new one meanwhile
+	std::shared_ptr<Model> model = currentModel();
+	int count = model ? model->count.load(std::memory_order_acquire) : 0;
+	if (count == 0) {
+		throw std::runtime_error("Model is not initialized");
+	}
+	cv::Mat sample = prepareSample(img);
+	return classify(*model, count, sample.ptr<float>(0), confidence);
+}
 
-	if (_pModel.empty()) {
+// Recognize the glyphs of a field from their prepared samples, all on one model snapshot.
+std::string KNearestOcr::recognize(const GlyphBatch& glyphs, std::vector<float>* confidences) {
+	std::shared_ptr<Model> model = currentModel();
+	int count = model ? model->count.load(std::memory_order_acquire) : 0;
+	if (count == 0) {
 		throw std::runtime_error("Model is not initialized");
 	}
+	std::string result;
+	if (confidences) {
+		confidences->clear();
+	}
+	for (int i = 0; i < glyphs.size(); i++) {
+		float confidence = 0.f;
+		result += classify(*model, count, glyphs.sample(i), &confidence);
+		if (confidences) {
+			confidences->push_back(confidence);
+		}
+	}
+	return result;
+}
 
-	cv::Mat results, neighborResponses, dists;
-	using namespace std;
-	ofs << prepareSample(img) << endl;
-	float result = _pModel->findNearest(prepareSample(img), k_idx, results, neighborResponses, dists);
+// Classify a prepared sample with the first count samples of the model.
+// Returns '?' if no training sample lies within ocrMaxDist. The confidence is the share
+// of the k neighbors that voted for the result, scaled down as the nearest one approaches ocrMaxDist.
+char KNearestOcr::classify(const Model& model, int count, const float* sample, float* confidence) {
+	char cres = '?';
+	const int k_idx(3);
 
-	// Find majority character of neigborResponses set. (k_idx should be odd number to determine the character)
-	std::vector<int> neighborResponsesCount; // 0,1,2,3,4,5,6,7,8,9,'.'
-	neighborResponsesCount.clear();
-	for (int i=0; i<11; i++) neighborResponsesCount.push_back(0);
-	for (int i=0; i < neighborResponses.cols; i++) {
-		if ((int)neighborResponses.at<float>(0,i) == -2) { neighborResponsesCount[10]++; continue; }
-		neighborResponsesCount[(int)neighborResponses.at<float>(0,i)]++;
+	Neighbor neighbors[k_idx];
+	int found = findNearest(model.samples.rowRange(0, count), model.responses.rowRange(0, count),
+			sample, k_idx, _config.getOcrMaxDist(), neighbors);
+	if (found == 0) {
+		if (confidence) *confidence = 0.f;
+		LOG_DEBUG("results: ? (no sample within ocrMaxDist)");
+		return cres;
 	}
-
-	int maxResponse = *max_element(neighborResponsesCount.begin(), neighborResponsesCount.end());
-	for (int i=0;i<neighborResponsesCount.size();i++) {
-		if (neighborResponsesCount[i] == maxResponse) {
-			if (i == 10) { results = -2; break; }
-			else 		 { results =  i; break; }
+	cres = vote(neighbors, found);
+	if (confidence) {
+		int votes = 0;
+		for (int i = 0; i < found; i++) {
+			if ('0' + (int) neighbors[i].response == cres) votes++;
 		}
-	}	// set value
+		*confidence = (float) votes / k_idx * std::max(0.f, 1.f - neighbors[0].dist / _config.getOcrMaxDist());
+	}
 
-	cres = '0' + (int) result;
+#ifndef KNNOCR_NO_DEBUG_LOG
+	if (Logger::instance().enabled(Logger::DEBUG)) {
+		std::ostringstream neighborLog;
+		neighborLog << "results: " << cres << ", neighbors:";
+		for (int i = 0; i < found; i++) neighborLog << " " << neighbors[i].response << "@" << neighbors[i].dist;
+		LOG_DEBUG(neighborLog.str());
+	}
+#endif
 
-	std::cout << "results: " << results << std::endl;
-	std::cout << "neighborResponses: " << neighborResponses << std::endl;
-	std::cout << "dists: " << dists << std::endl;
+	return cres;
+}
 
+// Prepare an image of a digit to work as a sample for the model.
+// Uses the kernel of the glyph batches, so learned and recognized samples match.
+cv::Mat KNearestOcr::prepareSample(const cv::Mat& img) {
+	cv::Mat sample(1, GlyphBatch::SAMPLE_DIMS, CV_32F);
+	GlyphBatch::prepare(img, sample.ptr<float>(0));
+	return sample;
+}
+
+// Find majority character of the neighbors found (k should be odd number to determine the character).
+// Neighbors are sorted by distance, so on a tie the class of the nearer neighbor wins.
+char KNearestOcr::vote(const Neighbor* neighbors, int found) {
+	char cres = '?';
+	int maxCount = 0;
+	for (int i = 0; i < found; i++) {
+		int count = 0;
+		for (int j = 0; j < found; j++) {
+			if (neighbors[j].response == neighbors[i].response) count++;
+		}
+		if (count > maxCount) {
+			maxCount = count;
+			cres = '0' + (int) neighbors[i].response; // '.' is stored as -2
+		}
+	}
 	return cres;
 }
 
-// Recognize a vector of digits.
-std::string KNearestOcr::recognize(const std::vector<cv::Mat>& images) {
-	std::string result;
-	for (std::vector<cv::Mat>::const_iterator it = images.begin();
-			it != images.end(); ++it) {
-		result += recognize(*it);
+// Find the k nearest training samples of a prepared sample by squared euclidean distance.
+// A candidate is abandoned as soon as its partial distance exceeds the current k-th best
+// distance or maxDist. Returns the number of neighbors found, sorted by distance.
+int KNearestOcr::findNearest(const cv::Mat& samples, const cv::Mat& responses, const float* sample,
+		int k, float maxDist, Neighbor* neighbors) {
+	const int dims = samples.cols;
+	int found = 0;
+
+	for (int r = 0; r < samples.rows; r++) {
+		const float* row = samples.ptr<float>(r);
+		float bound = (found < k) ? maxDist : std::min(maxDist, neighbors[k-1].dist);
+
+		// accumulate one glyph row at a time and check the bound in between
+		float dist = 0.f;
+		int d = 0;
+		while (d < dims && dist <= bound) {
+			int end = std::min(d + 10, dims);
+			for (; d < end; d++) {
+				float diff = row[d] - sample[d];
+				dist += diff * diff;
+			}
+		}
+		if (dist > bound) {
+			continue;
+		}
+
+		// insert into sorted neighbor list
+		int pos = (found < k) ? found++ : k - 1;
+		while (pos > 0 && neighbors[pos-1].dist > dist) {
+			neighbors[pos] = neighbors[pos-1];
+			pos--;
+		}
+		neighbors[pos].dist = dist;
+		neighbors[pos].response = responses.at<float>(r, 0);
+		neighbors[pos].index = r;
 	}
-	return result;
+	return found;
 }
 
-// Prepare an image of a digit to work as a sample for the model.
-cv::Mat KNearestOcr::prepareSample(const cv::Mat& img) {
-	cv::Mat roi, sample;
-	cv::resize(img, roi, cv::Size(10, 10));
-	ofs << roi << std::endl;
-	roi.reshape(1,1).convertTo(sample, CV_32F);
+// Generations of all recognizers in the process, so a generation names one snapshot of one recognizer.
+static std::atomic<uint64_t> lastGeneration(0);
 
-	return sample;
+// Each thread keeps the snapshot it used last. While the generation is unchanged this costs
+// one atomic load and no lock; after a publish the thread fetches the new snapshot once.
+std::shared_ptr<KNearestOcr::Model> KNearestOcr::currentModel() const {
+	struct Cache {
+		uint64_t generation; // 0 with no model
+		std::shared_ptr<Model> model;
+	};
+	static thread_local Cache cache = { 0, nullptr };
+	if (cache.generation != _generation.load(std::memory_order_acquire)) {
+		std::lock_guard<std::mutex> lock(_modelMutex);
+		cache.model = _model;
+		cache.generation = _modelGeneration;
+	}
+	return cache.model;
 }
 
-// Initialize the model.
-void KNearestOcr::initModel() {
-	_pModel = cv::ml::KNearest::create();
-	// load persistent model
-	cv::Ptr<cv::ml::TrainData> trainData = cv::ml::TrainData::create(_samples, cv::ml::ROW_SAMPLE, _responses);
-	_pModel->train(trainData);
+// Publish a new snapshot. Caller must hold _writeMutex.
+void KNearestOcr::publishModel(const std::shared_ptr<Model>& model) {
+	{
+		std::lock_guard<std::mutex> lock(_modelMutex);
+		_model = model;
+		_modelGeneration = lastGeneration.fetch_add(1, std::memory_order_relaxed) + 1;
+		_generation.store(_modelGeneration, std::memory_order_release);
+	}
+	Metrics::instance().modelSamples.set(model ? model->count.load() : 0);
 }
 
+// Read training data from file into a new snapshot. Returns null if the file is missing or invalid.
+std::shared_ptr<KNearestOcr::Model> KNearestOcr::loadModel(const std::string& filename) {
+	cv::Mat samples, responses;
+	try {
+		cv::FileStorage fs(filename, cv::FileStorage::READ);
+		if (!fs.isOpened()) {
+			return nullptr;
+		}
+		fs["samples"] >> samples;
+		fs["responses"] >> responses;
+		fs.release();
+	} catch (const cv::Exception& e) {
+		LOG_ERROR("Failed to read training data " << filename << ": " << e.what());
+		return nullptr;
+	}
+	if (samples.cols != 100 || responses.rows != samples.rows) {
+		return nullptr;
+	}
+
+	std::shared_ptr<Model> model = std::make_shared<Model>(samples.rows);
+	samples.convertTo(model->samples, CV_32F);
+	responses.reshape(1, responses.rows).convertTo(model->responses, CV_32F);
+	model->count.store(samples.rows, std::memory_order_release);
+	return model;
+}
+
+// Copy the valid rows of a snapshot into a new one with the given capacity, leaving out row skip.
+std::shared_ptr<KNearestOcr::Model> KNearestOcr::copyModel(const Model& model, int capacity, int skip) {
+	std::shared_ptr<Model> copy = std::make_shared<Model>(capacity);
+	int count = model.count.load(std::memory_order_acquire);
+	int n = 0;
+	for (int r = 0; r < count; r++) {
+		if (r == skip) continue;
+		model.samples.row(r).copyTo(copy->samples.row(n));
+		copy->responses.at<float>(n, 0) = model.responses.at<float>(r, 0);
+		n++;
+	}
+	copy->count.store(n, std::memory_order_release);
+	return copy;
+}
+
+// Append prepared samples behind the last valid row of the current snapshot.
+// Readers only see the new rows once count is published. If the store is full, a copy
+// with twice the capacity is published, so appending costs amortized O(1) copies.
+// With replace the samples go into a new snapshot instead. Returns the index of the first appended sample.
+int KNearestOcr::appendSamples(const cv::Mat& samples, const cv::Mat& responses, bool replace) {
+	std::lock_guard<std::mutex> lock(_writeMutex);
+	std::shared_ptr<Model> model = replace ? nullptr : currentModel();
+	if (!model) {
+		model = std::make_shared<Model>(0);
+	}
+	int count = model->count.load(std::memory_order_acquire);
+	if (count + samples.rows > model->samples.rows) {
+		int capacity = std::max(count + samples.rows, std::max(2 * model->samples.rows, 64));
+		model = copyModel(*model, capacity);
+	}
+	if (samples.rows > 0) {
+		samples.copyTo(model->samples.rowRange(count, count + samples.rows));
+		responses.copyTo(model->responses.rowRange(count, count + samples.rows));
+	}
+	model->count.store(count + samples.rows, std::memory_order_release);
+	if (model != currentModel()) {
+		publishModel(model);
+	}
+	Metrics::instance().modelSamples.set(count + samples.rows);
+	return count;
+}
+
+// Watcher thread: poll the training data file and reload it once it stopped changing.
+void KNearestOcr::watch(int intervalMs) {
+	const std::string filename = _config.getTrainingDataFilename();
+	struct stat st;
+
+	std::unique_lock<std::mutex> lock(_watchMutex);
+	stat(filename.c_str(), &_seen);
+	_reloadPending = false;
+	while (_watching) {
+		_watchCond.wait_for(lock, std::chrono::milliseconds(intervalMs));
+		if (!_watching || stat(filename.c_str(), &st) != 0) {
+			continue;
+		}
+		if (st.st_mtime != _seen.st_mtime || st.st_size != _seen.st_size || st.st_ino != _seen.st_ino) {
+			_seen = st;
+			_reloadPending = true;
+			continue;
+		}
+		if (!_reloadPending) {
+			continue;
+		}
+		_reloadPending = false;
+		const uint64_t saves = _saves;
+
+		lock.unlock();
+		std::shared_ptr<Model> model = loadModel(filename);
+		lock.lock();
+		if (_saves != saves) {
+			// saved while loading, the current model is newer than the file we read
+			continue;
+		}
+		if (model) {
+			std::lock_guard<std::mutex> writeLock(_writeMutex);
+			publishModel(model);
+			Metrics::instance().modelReloads.inc();
+			LOG_INFO("Training data reloaded: " << model->count.load() << " samples");
+		} else {
+			Metrics::instance().modelReloadFailures.inc();
+			LOG_WARN("Failed to reload training data, keeping current model");
+		}
+	}
+}
@@ -0,0 +1,144 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+
+#include "Log.h"
+
+static void closeAtExit() {
+	Logger::instance().close();
+}
+
+// The logger lives until the process ends, so objects destroyed at exit can still log.
+// Pending messages are flushed by an exit handler, later ones are written directly.
+Logger& Logger::instance() {
+	static Logger* logger = new Logger();
+	return *logger;
+}
+
+Logger::Logger() :
+		_level(INFO), _ring(CAPACITY), _batch(CAPACITY), _head(0), _count(0), _busy(false), _running(true),
+		_dropped(0), _reportedDropped(0) {
+	std::thread(&Logger::run, this).detach();
+	atexit(closeAtExit);
+}
+
+void Logger::write(Level level, const std::string& message) {
+	if (!enabled(level)) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+	Entry* entry;
+	Entry direct;
+	if (!_running) {
+		entry = &direct;
+	} else if (_count == CAPACITY) {
+		_dropped++;
+		return;
+	} else {
+		entry = &_ring[(_head + _count) % CAPACITY];
+	}
+	entry->level = level;
+	clock_gettime(CLOCK_REALTIME, &entry->time);
+	entry->length = (int) std::min(message.size(), (size_t) MAX_MESSAGE);
+	memcpy(entry->text, message.data(), entry->length);
+	if (entry == &direct) {
+		print(direct);
+		fflush(level >= WARN ? stderr : stdout);
+		return;
+	}
+	_count++;
+	_ready.notify_one();
+}
+
+// Wait until all queued messages are written.
+void Logger::flush() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_drained.wait(lock, [this] { return _count == 0 && !_busy; });
+}
+
+// Flush and write further messages directly. Called at exit, so nothing is lost
+// when the process ends while the writer thread still holds messages.
+void Logger::close() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_drained.wait(lock, [this] { return _count == 0 && !_busy; });
+	_running = false;
+	fflush(stdout);
+	fflush(stderr);
+}
+
+bool Logger::parseLevel(const std::string& name, Level& level) {
+	static const Level levels[] = { DEBUG, INFO, WARN, ERROR, OFF };
+	for (Level l : levels) {
+		if (name == levelName(l)) {
+			level = l;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* Logger::levelName(Level level) {
+	switch (level) {
+		case DEBUG: return "DEBUG";
+		case INFO: return "INFO";
+		case WARN: return "WARN";
+		case ERROR: return "ERROR";
+		case OFF: return "OFF";
+	}
+	return "";
+}
+
+// Writer thread: take all queued messages at once and write them with one flush per batch.
+void Logger::run() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true) {
+		_ready.wait(lock, [this] { return _count > 0; });
+		int n = _count;
+		for (int i = 0; i < n; i++) {
+			_batch[i] = _ring[(_head + i) % CAPACITY];
+		}
+		_head = (_head + n) % CAPACITY;
+		_count = 0;
+		_busy = true;
+		long dropped = _dropped.load();
+		lock.unlock();
+
+		if (dropped != _reportedDropped) {
+			fprintf(stderr, "%ld log messages dropped\n", dropped - _reportedDropped);
+			_reportedDropped = dropped;
+		}
+		for (int i = 0; i < n; i++) {
+			print(_batch[i]);
+		}
+		fflush(stdout);
+		fflush(stderr);
+
+		lock.lock();
+		_busy = false;
+		_drained.notify_all();
+	}
+}
+
+void Logger::print(const Entry& entry) {
+	struct tm date;
+	localtime_r(&entry.time.tv_sec, &date);
+	char stamp[16];
+	strftime(stamp, sizeof(stamp), "%H:%M:%S", &date);
+	fprintf(entry.level >= WARN ? stderr : stdout, "%s.%03ld %-5s %.*s\n", stamp, entry.time.tv_nsec / 1000000,
+			levelName(entry.level), entry.length, entry.text);
+}
+
+bool LogRateLimiter::allow(long& suppressed) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t t = int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+	int64_t next = _next.load(std::memory_order_relaxed);
+	if (t < next || !_next.compare_exchange_strong(next, t + _intervalNs)) {
+		_suppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+	return true;
+}
@@ -0,0 +1,280 @@
+#include <fstream>
+#include <sstream>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "Metrics.h"
+#include "Log.h"
+
+// Prometheus label values of ChannelValidator::Status.
+static const char* statusLabels[Metrics::STATUSES] = {
+	"accepted", "pending", "parse", "range", "unstable", "rate"
+};
+
+static volatile sig_atomic_t dumpRequested = 0;
+
+static volatile sig_atomic_t traceRequested = 0;
+
+static void requestDump(int) {
+	dumpRequested = 1;
+}
+
+static void requestTrace(int) {
+	traceRequested = 1;
+}
+
+Histogram::Histogram() : _sum(0), _count(0) {
+	for (int i = 0; i <= BUCKETS; i++) {
+		_buckets[i] = 0;
+	}
+}
+
+void Histogram::observe(uint64_t micros) {
+	// smallest bucket with 2^b >= micros
+	int b = micros <= 1 ? 0 : 64 - __builtin_clzll(micros - 1);
+	if (b > BUCKETS) b = BUCKETS;
+	_buckets[b].fetch_add(1, std::memory_order_relaxed);
+	_sum.fetch_add(micros, std::memory_order_relaxed);
+	_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Histogram::write(std::ostream& os, const std::string& name, const std::string& help) const {
+	os << "# HELP " << name << " " << help << "\n";
+	os << "# TYPE " << name << " histogram\n";
+	uint64_t cumulative = 0;
+	for (int i = 0; i < BUCKETS; i++) {
+		cumulative += _buckets[i].load(std::memory_order_relaxed);
+		os << name << "_bucket{le=\"" << upperBound(i) * 1e-6 << "\"} " << cumulative << "\n";
+	}
+	cumulative += _buckets[BUCKETS].load(std::memory_order_relaxed);
+	os << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+	os << name << "_sum " << _sum.load(std::memory_order_relaxed) * 1e-6 << "\n";
+	// scrapes are not atomic across buckets, keep count consistent with the buckets
+	os << name << "_count " << cumulative << "\n";
+}
+
+static void writeCounter(std::ostream& os, const std::string& name, const std::string& help, uint64_t value,
+		const char* type = "counter") {
+	os << "# HELP " << name << " " << help << "\n";
+	os << "# TYPE " << name << " " << type << "\n";
+	os << name << " " << value << "\n";
+}
+
+Metrics& Metrics::instance() {
+	static Metrics metrics;
+	return metrics;
+}
+
+// Channels register once at construction, the returned counters are then used lock free.
+Counter* Metrics::validationCounters(const std::string& channel) {
+	std::lock_guard<std::mutex> lock(_channelMutex);
+	int n = _channels.load();
+	for (int i = 0; i < n; i++) {
+		if (_channelNames[i] == channel) return _validations[i];
+	}
+	if (n == MAX_CHANNELS) {
+		return nullptr;
+	}
+	_channelNames[n] = channel;
+	_channels.store(n + 1);
+	return _validations[n];
+}
+
+void Metrics::write(std::ostream& os) const {
+	capture.write(os, "knnocr_capture_seconds", "Time to capture a frame.");
+	process.write(os, "knnocr_process_seconds", "Time to preprocess a frame and isolate the digits.");
+	segment.write(os, "knnocr_segment_seconds", "Time to segment the digits within the regions of interest.");
+	recognize.write(os, "knnocr_recognize_seconds", "Time to recognize the digits of a channel.");
+	validate.write(os, "knnocr_validate_seconds", "Time to validate the readings of a frame.");
+
+	writeCounter(os, "knnocr_frames_captured_total", "Frames captured.", framesCaptured.get());
+	writeCounter(os, "knnocr_capture_failures_total", "Frames the input failed to deliver.", captureFailures.get());
+	writeCounter(os, "knnocr_recorder_dropped_total", "Frames dropped by the video recorder.", recorderDropped.get());
+	writeCounter(os, "knnocr_bus_published_total", "Records published on the reading bus.", busPublished.get());
+	writeCounter(os, "knnocr_deadlines_missed_total", "Frames that overran their deadline.", deadlinesMissed.get());
+	writeCounter(os, "knnocr_segment_cache_hits_total", "Display fields cropped with the learned digit cells.",
+			segmentCacheHits.get());
+	writeCounter(os, "knnocr_segment_check_failures_total",
+			"Display fields whose learned digit layout failed the ink check and were segmented again.",
+			segmentCheckFailures.get());
+	writeCounter(os, "knnocr_flight_dumps_total", "Frame windows written by the flight recorder.", flightDumps.get());
+	writeCounter(os, "knnocr_frame_period_milliseconds", "Current frame period of the scheduler.", framePeriod.get(),
+			"gauge");
+	writeCounter(os, "knnocr_model_samples", "Samples in the current OCR model.", modelSamples.get(), "gauge");
+	writeCounter(os, "knnocr_model_reloads_total", "Background reloads of the training data.", modelReloads.get());
+	writeCounter(os, "knnocr_model_reload_failures_total", "Failed reloads of the training data.",
+			modelReloadFailures.get());
+
+	os << "# HELP knnocr_validations_total Validation outcomes per channel.\n";
+	os << "# TYPE knnocr_validations_total counter\n";
+	int n = _channels.load();
+	for (int c = 0; c < n; c++) {
+		for (int s = 0; s < STATUSES; s++) {
+			os << "knnocr_validations_total{channel=\"" << _channelNames[c] << "\",status=\"" << statusLabels[s]
+					<< "\"} " << _validations[c][s].get() << "\n";
+		}
+	}
+}
+
+// Write the metrics to a temporary file and rename it, readers never see a partial dump.
+bool Metrics::dump(const std::string& filename) const {
+	std::string tmp = filename + ".tmp";
+	std::ofstream ofs(tmp.c_str());
+	write(ofs);
+	ofs.close();
+	if (!ofs || rename(tmp.c_str(), filename.c_str()) != 0) {
+		LOG_ERROR("Failed to write metrics to " << filename);
+		return false;
+	}
+	return true;
+}
+
+MetricsExporter::MetricsExporter(int port, const std::string& dumpFile) :
+		_port(port), _dumpFile(dumpFile), _traceEvents(0), _socket(-1), _running(false) {
+}
+
+void MetricsExporter::setTrace(const std::string& traceFile, int traceEvents) {
+	_traceFile = traceFile;
+	_traceEvents = traceEvents;
+}
+
+MetricsExporter::~MetricsExporter() {
+	stop();
+}
+
+void MetricsExporter::start() {
+	if (_running) {
+		return;
+	}
+	if (_port > 0 && !listenOn(_port)) {
+		LOG_WARN("Metrics endpoint disabled, cannot listen on port " << _port);
+	}
+	if (!_dumpFile.empty()) {
+		signal(SIGUSR1, requestDump);
+	}
+	if (!_traceFile.empty() && _traceEvents > 0) {
+		signal(SIGUSR2, requestTrace);
+	}
+	_running = true;
+	_thread = std::thread(&MetricsExporter::run, this);
+}
+
+void MetricsExporter::stop() {
+	if (!_running) {
+		return;
+	}
+	_running = false;
+	_thread.join();
+	if (_socket >= 0) {
+		close(_socket);
+		_socket = -1;
+	}
+	// a trace still running is written on exit
+	if (Tracer::enabled() && !_traceFile.empty()) {
+		toggleTrace();
+	}
+}
+
+void MetricsExporter::toggleTrace() {
+	Tracer& tracer = Tracer::instance();
+	if (!Tracer::enabled()) {
+		tracer.start(_traceEvents);
+		LOG_INFO("Tracing started, " << _traceEvents << " spans");
+	} else {
+		tracer.stop();
+		if (tracer.dump(_traceFile)) {
+			LOG_INFO("Trace written to " << _traceFile);
+		}
+	}
+}
+
+// Listen on the loopback interface only, the endpoint is for local scrapers.
+bool MetricsExporter::listenOn(int port) {
+	_socket = socket(AF_INET, SOCK_STREAM, 0);
+	if (_socket < 0) {
+		return false;
+	}
+	int on = 1;
+	setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(_socket, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(_socket, 4) != 0) {
+		close(_socket);
+		_socket = -1;
+		return false;
+	}
+	return true;
+}
+
+void MetricsExporter::run() {
+	while (_running) {
+		struct pollfd pfd = { _socket, POLLIN, 0 };
+		int ready = poll(&pfd, _socket >= 0 ? 1 : 0, 250);
+		if (dumpRequested) {
+			dumpRequested = 0;
+			Metrics::instance().dump(_dumpFile);
+		}
+		if (traceRequested) {
+			traceRequested = 0;
+			toggleTrace();
+		}
+		if (ready > 0 && (pfd.revents & POLLIN)) {
+			int client = accept(_socket, nullptr, nullptr);
+			if (client >= 0) {
+				serve(client);
+				close(client);
+			}
+		}
+	}
+}
+
+// Answer a single HTTP request, GET /metrics or GET /.
+void MetricsExporter::serve(int client) {
+	struct timeval timeout = { 1, 0 };
+	setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	char request[1024];
+	ssize_t n = recv(client, request, sizeof(request) - 1, 0);
+	if (n <= 0) {
+		return;
+	}
+	request[n] = 0;
+
+	std::ostringstream body;
+	std::string status = "200 OK";
+	std::string type = "text/plain; version=0.0.4";
+	if (strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0) {
+		Metrics::instance().write(body);
+	} else if (strncmp(request, "GET /trace", 10) == 0) {
+		Tracer::instance().write(body);
+		type = "application/json";
+	} else {
+		status = "404 Not Found";
+	}
+	std::string content = body.str();
+	std::ostringstream response;
+	response << "HTTP/1.0 " << status << "\r\n"
+			<< "Content-Type: " << type << "\r\n"
+			<< "Content-Length: " << content.size() << "\r\n"
+			<< "Connection: close\r\n\r\n" << content;
+	std::string out = response.str();
+	const char* p = out.data();
+	size_t left = out.size();
+	while (left > 0) {
+		ssize_t sent = send(client, p, left, MSG_NOSIGNAL);
+		if (sent <= 0) break;
+		p += sent;
+		left -= sent;
+	}
+}
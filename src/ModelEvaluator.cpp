@@ -0,0 +1,227 @@
+#include <opencv2/core/core.hpp>
+#include <opencv2/ml/ml.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cfloat>
+
+#include "KNearestOcr.h"
+#include "ModelEvaluator.h"
+
+// 0..9, '.', '?' (rejected)
+static const int NUM_CLASSES = 12;
+
+ModelEvaluator::ModelEvaluator(const Config& config, const cv::Mat& samples, const cv::Mat& responses) :
+		_config(config), _samples(samples), _responses(responses) {
+}
+
+// Run cross validation with the given number of folds, leave-one-out if folds < 2.
+void ModelEvaluator::evaluate(int folds) {
+	const int n = _samples.rows;
+	if (folds >= n) {
+		folds = 0;
+	}
+	std::cout << "## Evaluating " << n << " samples, "
+			<< (folds < 2 ? std::string("leave-one-out") : std::to_string(folds) + "-fold") << " ##\n";
+
+	// accuracy and throughput per backend and k
+	const Backend backends[] = { NATIVE, CV_BRUTE_FORCE, CV_KDTREE };
+	const int ks[] = { 1, 3, 5 };
+	std::cout << "\n" << std::left << std::setw(14) << "backend" << std::right << std::setw(4) << "k"
+			<< std::setw(10) << "accuracy" << std::setw(9) << "rejects" << std::setw(14) << "digits/s" << "\n";
+	for (Backend backend : backends) {
+		for (int k : ks) {
+			Result result;
+			classify(backend, k, folds, (backend == NATIVE) ? _config.getOcrMaxDist() : FLT_MAX, result);
+			int correct = 0, rejects = 0;
+			for (int i = 0; i < n; i++) {
+				if (result.predicted[i] == label(i)) correct++;
+				if (result.predicted[i] == '?') rejects++;
+			}
+			std::cout << std::left << std::setw(14) << backendName(backend) << std::right << std::setw(4) << k
+					<< std::setw(9) << std::fixed << std::setprecision(2) << 100. * correct / n << "%"
+					<< std::setw(9) << rejects
+					<< std::setw(14) << std::setprecision(0) << (result.seconds > 0 ? n / result.seconds : 0.) << "\n";
+		}
+	}
+
+	// confusion of the production configuration
+	Result result;
+	classify(NATIVE, 3, folds, _config.getOcrMaxDist(), result);
+	printConfusion(result);
+
+	// distances of the nearest neighbors, unbounded
+	classify(NATIVE, 1, folds, FLT_MAX, result);
+	printDistances(result);
+}
+
+void ModelEvaluator::classify(Backend backend, int k, int folds, float maxDist, Result& result) {
+	const int n = _samples.rows;
+	result.predicted.assign(n, '?');
+	result.nearestDist.assign(n, -1.f);
+	result.seconds = 0.;
+
+	if (folds < 2) {
+		// leave-one-out: query the full model and skip the query sample itself
+		std::vector<int> test(n);
+		for (int i = 0; i < n; i++) test[i] = i;
+		if (backend == NATIVE) {
+			classifyNative(_samples, _responses, test, true, k, maxDist, result);
+		} else {
+			classifyOpenCV(backend, _samples, _responses, test, true, k, result);
+		}
+		return;
+	}
+
+	for (int fold = 0; fold < folds; fold++) {
+		cv::Mat trainSamples, trainResponses;
+		std::vector<int> test;
+		for (int i = 0; i < n; i++) {
+			if (i % folds == fold) {
+				test.push_back(i);
+			} else {
+				trainSamples.push_back(_samples.row(i));
+				trainResponses.push_back(_responses.row(i));
+			}
+		}
+		if (backend == NATIVE) {
+			classifyNative(trainSamples, trainResponses, test, false, k, maxDist, result);
+		} else {
+			classifyOpenCV(backend, trainSamples, trainResponses, test, false, k, result);
+		}
+	}
+}
+
+void ModelEvaluator::classifyNative(const cv::Mat& trainSamples, const cv::Mat& trainResponses,
+		const std::vector<int>& test, bool excludeSelf, int k, float maxDist, Result& result) {
+	const int kq = excludeSelf ? k + 1 : k;
+	std::vector<KNearestOcr::Neighbor> neighbors(kq);
+
+	int64 start = cv::getTickCount();
+	for (int i : test) {
+		int found = KNearestOcr::findNearest(trainSamples, trainResponses, _samples.ptr<float>(i), kq, maxDist,
+				neighbors.data());
+		if (excludeSelf) {
+			// drop the query sample itself, or the farthest neighbor if it was not found
+			int self = 0;
+			while (self < found && neighbors[self].index != i) self++;
+			if (self < found) {
+				std::copy(neighbors.begin() + self + 1, neighbors.begin() + found, neighbors.begin() + self);
+				found--;
+			} else {
+				found = std::min(found, k);
+			}
+		}
+		if (found > 0) {
+			result.predicted[i] = KNearestOcr::vote(neighbors.data(), found);
+			result.nearestDist[i] = neighbors[0].dist;
+		}
+	}
+	result.seconds += (cv::getTickCount() - start) / cv::getTickFrequency();
+}
+
+void ModelEvaluator::classifyOpenCV(Backend backend, const cv::Mat& trainSamples, const cv::Mat& trainResponses,
+		const std::vector<int>& test, bool excludeSelf, int k, Result& result) {
+	const int kq = excludeSelf ? k + 1 : k;
+	cv::Ptr<cv::ml::KNearest> model = cv::ml::KNearest::create();
+	model->setAlgorithmType(backend == CV_KDTREE ? cv::ml::KNearest::KDTREE : cv::ml::KNearest::BRUTE_FORCE);
+	model->train(cv::ml::TrainData::create(trainSamples, cv::ml::ROW_SAMPLE, trainResponses));
+
+	cv::Mat query(0, _samples.cols, CV_32F);
+	for (int i : test) {
+		query.push_back(_samples.row(i));
+	}
+	cv::Mat results, neighborResponses, dists;
+
+	int64 start = cv::getTickCount();
+	model->findNearest(query, kq, results, neighborResponses, dists);
+	result.seconds += (cv::getTickCount() - start) / cv::getTickFrequency();
+
+	std::vector<KNearestOcr::Neighbor> neighbors;
+	for (int q = 0; q < (int) test.size(); q++) {
+		int i = test[q];
+		neighbors.clear();
+		bool selfSkipped = !excludeSelf;
+		for (int j = 0; j < neighborResponses.cols; j++) {
+			KNearestOcr::Neighbor nb = { dists.at<float>(q, j), neighborResponses.at<float>(q, j), -1 };
+			// the query sample itself is an exact match with its own label
+			if (!selfSkipped && nb.dist == 0.f && nb.response == _responses.at<float>(i, 0)) {
+				selfSkipped = true;
+				continue;
+			}
+			neighbors.push_back(nb);
+		}
+		if ((int) neighbors.size() > k) {
+			neighbors.resize(k);
+		}
+		result.predicted[i] = KNearestOcr::vote(neighbors.data(), (int) neighbors.size());
+		result.nearestDist[i] = neighbors.empty() ? -1.f : neighbors[0].dist;
+	}
+}
+
+void ModelEvaluator::printConfusion(const Result& result) {
+	std::vector<std::vector<int>> confusion(NUM_CLASSES, std::vector<int>(NUM_CLASSES, 0));
+	for (int i = 0; i < _samples.rows; i++) {
+		confusion[classIndex(label(i))][classIndex(result.predicted[i])]++;
+	}
+
+	const char names[] = "0123456789.?";
+	std::cout << "\n## Confusion (" << backendName(NATIVE) << ", k=3, rows: label, columns: result) ##\n    ";
+	for (int c = 0; c < NUM_CLASSES; c++) std::cout << std::setw(5) << names[c];
+	std::cout << std::setw(9) << "recall" << "\n";
+	for (int r = 0; r < NUM_CLASSES - 1; r++) {
+		int total = 0;
+		for (int c = 0; c < NUM_CLASSES; c++) total += confusion[r][c];
+		if (total == 0) continue;
+		std::cout << std::setw(4) << names[r];
+		for (int c = 0; c < NUM_CLASSES; c++) std::cout << std::setw(5) << confusion[r][c];
+		std::cout << std::setw(8) << std::fixed << std::setprecision(1) << 100. * confusion[r][r] / total << "%\n";
+	}
+}
+
+void ModelEvaluator::printDistances(const Result& result) {
+	std::vector<float> correct, wrong;
+	for (int i = 0; i < _samples.rows; i++) {
+		if (result.nearestDist[i] < 0.f) continue;
+		if (result.predicted[i] == label(i)) correct.push_back(result.nearestDist[i]);
+		else wrong.push_back(result.nearestDist[i]);
+	}
+	std::sort(correct.begin(), correct.end());
+	std::sort(wrong.begin(), wrong.end());
+
+	auto percentile = [](const std::vector<float>& v, double p) {
+		return v.empty() ? 0.f : v[std::min(v.size() - 1, (size_t) (p * v.size()))];
+	};
+	std::cout << "\n## Nearest neighbor distance (squared L2) ##\n";
+	std::cout << std::setprecision(0);
+	std::cout << "correct (" << correct.size() << "): p50 " << percentile(correct, .5) << ", p90 " << percentile(correct, .9)
+			<< ", p99 " << percentile(correct, .99) << ", max " << percentile(correct, 1.) << "\n";
+	if (!wrong.empty()) {
+		std::cout << "wrong   (" << wrong.size() << "): min " << wrong.front() << ", p50 " << percentile(wrong, .5)
+				<< ", max " << wrong.back() << "\n";
+	}
+	std::cout << "ocrMaxDist is " << _config.getOcrMaxDist() << ", "
+			<< std::count_if(correct.begin(), correct.end(), [this](float d) { return d > _config.getOcrMaxDist(); })
+			<< " correct digits would be rejected.\n";
+}
+
+char ModelEvaluator::label(int i) const {
+	return '0' + (int) _responses.at<float>(i, 0);
+}
+
+int ModelEvaluator::classIndex(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c == '.') return 10;
+	return 11;
+}
+
+const char* ModelEvaluator::backendName(Backend backend) {
+	switch (backend) {
+		case NATIVE: return "native";
+		case CV_BRUTE_FORCE: return "cv-bruteforce";
+		case CV_KDTREE: return "cv-kdtree";
+	}
+	return "";
+}
@@ -0,0 +1,7 @@
+#include "AllocationCounter.h"
+
+// The allocator is not interposed, allocations are not counted.
+bool allocationCount(uint64_t& count) {
+	count = 0;
+	return false;
+}
@@ -0,0 +1,204 @@
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ReadingBus.h"
+
+static const uint32_t BUS_MAGIC = 0x4b4e4e42; // "KNNB"
+static const uint32_t BUS_VERSION = 1;
+
+namespace {
+struct Slot {
+	std::atomic<uint64_t> seq; // 2 * index + 1 while writing, 2 * index + 2 when complete
+	BusRecord record;
+};
+}
+
+struct ReadingBus::Header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;
+	uint32_t recordSize;
+	std::atomic<uint64_t> published; // number of records published
+	char padding[40];
+
+	Slot* slots() { return reinterpret_cast<Slot*>(this + 1); }
+	const Slot* slots() const { return reinterpret_cast<const Slot*>(this + 1); }
+};
+
+ReadingBus::ReadingBus(const std::string& name, int capacity) :
+		_name(name), _capacity(capacity > 0 ? capacity : 1), _size(0), _header(0) {
+}
+
+ReadingBus::~ReadingBus() {
+	if (_header) {
+		munmap(_header, _size);
+	}
+}
+
+// Create the shared memory segment. A segment left by a previous run may still be mapped by
+// readers, so it is unlinked and a new one created rather than truncated and cleared under them.
+bool ReadingBus::open() {
+	_size = sizeof(Header) + (size_t) _capacity * sizeof(Slot);
+	shm_unlink(_name.c_str());
+	int fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0 || ftruncate(fd, _size) != 0) {
+		std::cerr << "Failed to create reading bus " << _name << ": " << strerror(errno) << std::endl;
+		if (fd >= 0) close(fd);
+		return false;
+	}
+	void* mem = mmap(0, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) {
+		std::cerr << "Failed to map reading bus " << _name << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	// a new segment reads as zeros
+	_header = static_cast<Header*>(mem);
+	_header->capacity = _capacity;
+	_header->recordSize = sizeof(BusRecord);
+	_header->version = BUS_VERSION;
+	_header->published.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	_header->magic = BUS_MAGIC;
+	return true;
+}
+
+// Publish a record, overwriting the oldest one. Never waits for readers.
+void ReadingBus::publish(const BusRecord& record) {
+	if (!_header) {
+		return;
+	}
+	uint64_t index = _header->published.load(std::memory_order_relaxed);
+	Slot& slot = _header->slots()[index % _capacity];
+
+	slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(&slot.record, &record, sizeof(BusRecord));
+	slot.seq.store(2 * index + 2, std::memory_order_release);
+	_header->published.store(index + 1, std::memory_order_release);
+}
+
+static int64_t monotonicNs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+ReadingBusReader::ReadingBusReader(const std::string& name) :
+		_name(name), _size(0), _header(0), _dev(0), _ino(0), _checkedNs(0), _next(0), _lost(0) {
+}
+
+ReadingBusReader::~ReadingBusReader() {
+	close();
+}
+
+void ReadingBusReader::close() {
+	if (_header) {
+		munmap(const_cast<ReadingBus::Header*>(_header), _size);
+		_header = 0;
+	}
+}
+
+bool ReadingBusReader::open() {
+	int fd = shm_open(_name.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ReadingBus::Header)) {
+		::close(fd);
+		return false;
+	}
+	void* mem = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mem == MAP_FAILED) {
+		return false;
+	}
+	const ReadingBus::Header* header = static_cast<const ReadingBus::Header*>(mem);
+	if (header->magic != BUS_MAGIC || header->version != BUS_VERSION || header->recordSize != sizeof(BusRecord)
+			|| (size_t) st.st_size < sizeof(ReadingBus::Header) + header->capacity * sizeof(Slot)) {
+		munmap(mem, st.st_size);
+		return false;
+	}
+	close();
+	_header = header;
+	_size = st.st_size;
+	_dev = st.st_dev;
+	_ino = st.st_ino;
+	_checkedNs = monotonicNs();
+	_next = 0;
+	return true;
+}
+
+// The name refers to another segment than ours: the producer restarted.
+bool ReadingBusReader::replaced() {
+	int fd = shm_open(_name.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	bool other = fstat(fd, &st) == 0 && (st.st_dev != _dev || st.st_ino != _ino);
+	::close(fd);
+	return other;
+}
+
+bool ReadingBusReader::next(BusRecord& record) {
+	if (!_header) {
+		return false;
+	}
+	while (true) {
+		const uint64_t capacity = _header->capacity;
+		uint64_t published = _header->published.load(std::memory_order_acquire);
+		if (published < _next) {
+			// the count went back, a new run started in this segment
+			_next = 0;
+			continue;
+		}
+		if (_next == published) {
+			int64_t now = monotonicNs();
+			if (now - _checkedNs < 1000000000) {
+				return false;
+			}
+			_checkedNs = now;
+			// the new segment holds only records of the new run, read them all
+			if (!replaced() || !open()) {
+				return false;
+			}
+			continue;
+		}
+		if (published - _next > capacity) {
+			// the producer lapped us
+			_lost += published - capacity - _next;
+			_next = published - capacity;
+		}
+
+		const Slot& slot = _header->slots()[_next % capacity];
+		uint64_t expected = 2 * _next + 2;
+		uint64_t seq1 = slot.seq.load(std::memory_order_acquire);
+		if (seq1 == expected) {
+			memcpy(&record, &slot.record, sizeof(BusRecord));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t seq2 = slot.seq.load(std::memory_order_relaxed);
+			if (seq2 == expected) {
+				_next++;
+				return true;
+			}
+		}
+		// overwritten while reading, catch up
+		_lost++;
+		_next++;
+	}
+}
+
+void ReadingBusReader::seekToEnd() {
+	if (_header) {
+		_next = _header->published.load(std::memory_order_acquire);
+	}
+}
@@ -0,0 +1,207 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ReadingStore.h"
+#include "Log.h"
+
+// A value that did not change is written again once per this many seconds.
+static const int64_t HEARTBEAT = 60;
+
+ReadingStore::ReadingStore(const std::string& directory, int batchSize, FsyncPolicy policy, int fsyncInterval) :
+		_directory(directory), _batchSize(std::max(1, batchSize)), _policy(policy), _fsyncInterval(fsyncInterval),
+		_rawFd(-1), _rollupFd(-1), _lastSync(0) {
+	memset(_last, 0, sizeof(_last));
+	for (int c = 0; c < NUM_CHANNELS; c++) {
+		_hasLast[c] = false;
+		_aggregate[c].minute = -1;
+		_aggregate[c].count = 0;
+		_aggregate[c].sum = 0.;
+	}
+}
+
+ReadingStore::~ReadingStore() {
+	for (int c = 0; c < NUM_CHANNELS; c++) {
+		closeRollup((Channel) c);
+	}
+	flush();
+	if (_rawFd >= 0) close(_rawFd);
+	if (_rollupFd >= 0) close(_rollupFd);
+}
+
+// Create the store directory if needed and open the files for appending.
+bool ReadingStore::open() {
+	if (mkdir(_directory.c_str(), 0755) != 0 && errno != EEXIST) {
+		LOG_ERROR("Failed to create " << _directory << ": " << strerror(errno));
+		return false;
+	}
+	_rawFd = ::open((_directory + "/raw.dat").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	_rollupFd = ::open((_directory + "/1m.dat").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (_rawFd < 0 || _rollupFd < 0) {
+		LOG_ERROR("Failed to open reading store in " << _directory << ": " << strerror(errno));
+		return false;
+	}
+	time(&_lastSync);
+	return true;
+}
+
+// Add a validated reading. Records are written in batches.
+void ReadingStore::append(Channel channel, const Reading& reading) {
+	Record record;
+	memset(&record, 0, sizeof(record));
+	record.time = reading.time;
+	record.value = (float) reading.value;
+	record.channel = (uint8_t) channel;
+
+	// rollup of the current minute, a new minute closes older minutes of all channels
+	// to keep the rollup file sorted by time
+	Aggregate& agg = _aggregate[channel];
+	int64_t minute = record.time - record.time % 60;
+	if (agg.minute != minute) {
+		for (int c = 0; c < NUM_CHANNELS; c++) {
+			if (c == channel || _aggregate[c].minute < minute) {
+				closeRollup((Channel) c);
+			}
+		}
+		agg.minute = minute;
+		agg.min = agg.max = record.value;
+	}
+	agg.count++;
+	agg.sum += record.value;
+	agg.min = std::min(agg.min, record.value);
+	agg.max = std::max(agg.max, record.value);
+
+	// raw record only for changes and heartbeats
+	if (_hasLast[channel] && _last[channel].value == record.value && record.time - _last[channel].time < HEARTBEAT) {
+		return;
+	}
+	_last[channel] = record;
+	_hasLast[channel] = true;
+	_records.push_back(record);
+
+	if ((int) _records.size() >= _batchSize) {
+		flush();
+	}
+}
+
+// Write buffered records and sync according to the policy.
+void ReadingStore::flush() {
+	if (_rawFd < 0) {
+		return;
+	}
+	bool written = !_records.empty() || !_rollups.empty();
+	if (!_records.empty() && writeAll(_rawFd, _records.data(), _records.size() * sizeof(Record))) {
+		_records.clear();
+	}
+	if (!_rollups.empty() && writeAll(_rollupFd, _rollups.data(), _rollups.size() * sizeof(Rollup))) {
+		_rollups.clear();
+	}
+	if (!written) {
+		return;
+	}
+
+	time_t now = time(0);
+	if (_policy == FSYNC_BATCH || (_policy == FSYNC_INTERVAL && now - _lastSync >= _fsyncInterval)) {
+		fdatasync(_rawFd);
+		fdatasync(_rollupFd);
+		_lastSync = now;
+	}
+}
+
+void ReadingStore::closeRollup(Channel channel) {
+	Aggregate& agg = _aggregate[channel];
+	if (agg.count == 0) {
+		return;
+	}
+	Rollup rollup;
+	memset(&rollup, 0, sizeof(rollup));
+	rollup.time = agg.minute;
+	rollup.channel = (uint8_t) channel;
+	rollup.count = agg.count;
+	rollup.min = agg.min;
+	rollup.max = agg.max;
+	rollup.mean = (float) (agg.sum / agg.count);
+	_rollups.push_back(rollup);
+
+	agg.count = 0;
+	agg.sum = 0.;
+}
+
+bool ReadingStore::writeAll(int fd, const void* data, size_t size) {
+	const char* p = (const char*) data;
+	while (size > 0) {
+		ssize_t n = write(fd, p, size);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			LOG_EVERY(Logger::ERROR, 10000, "Failed to write reading store: " << strerror(errno));
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool ReadingStore::query(Channel channel, time_t from, time_t to,
+		const std::function<void(const Record&)>& callback) const {
+	return scan<Record>(_directory + "/raw.dat", channel, from, to, callback);
+}
+
+bool ReadingStore::queryRollups(Channel channel, time_t from, time_t to,
+		const std::function<void(const Rollup&)>& callback) const {
+	return scan<Rollup>(_directory + "/1m.dat", channel, from, to, callback);
+}
+
+// Binary search the first record at or after from, then read sequentially up to to.
+template<class T>
+bool ReadingStore::scan(const std::string& filename, Channel channel, time_t from, time_t to,
+		const std::function<void(const T&)>& callback) const {
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	fstat(fd, &st);
+	off_t count = st.st_size / sizeof(T);
+
+	off_t lo = 0, hi = count;
+	T rec;
+	while (lo < hi) {
+		off_t mid = lo + (hi - lo) / 2;
+		if (pread(fd, &rec, sizeof(T), mid * sizeof(T)) != sizeof(T)) break;
+		if (rec.time < from) lo = mid + 1;
+		else hi = mid;
+	}
+
+	std::vector<T> chunk(1024);
+	bool done = false;
+	for (off_t pos = lo; pos < count && !done; pos += chunk.size()) {
+		ssize_t n = pread(fd, chunk.data(), chunk.size() * sizeof(T), pos * sizeof(T));
+		if (n <= 0) break;
+		for (size_t i = 0; i < n / sizeof(T); i++) {
+			if (chunk[i].time > to) { done = true; break; }
+			if (chunk[i].channel == channel) callback(chunk[i]);
+		}
+	}
+	close(fd);
+	return true;
+}
+
+ReadingStore::FsyncPolicy ReadingStore::parseFsyncPolicy(const std::string& policy) {
+	if (policy == "never") return FSYNC_NEVER;
+	if (policy == "interval") return FSYNC_INTERVAL;
+	return FSYNC_BATCH;
+}
+
+const char* ReadingStore::channelName(int channel) {
+	switch (channel) {
+		case KV: return "kV";
+		case MA: return "mA";
+	}
+	return "?";
+}
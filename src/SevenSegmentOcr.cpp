@@ -0,0 +1,21 @@
+
+#include "SevenSegmentOcr.h"
+#include "Log.h"
+
+constexpr float StandardSegmentGeometry::x[8];
+constexpr float StandardSegmentGeometry::y[8];
+constexpr float ItalicSegmentGeometry::x[8];
+constexpr float ItalicSegmentGeometry::y[8];
+
+DigitRecognizer* createSevenSegmentOcr(const Config& config) {
+	if (config.getOcrEngine() != "segment") {
+		return nullptr;
+	}
+	if (config.getSegmentGeometry() == "italic") {
+		return new SevenSegmentOcr<ItalicSegmentGeometry>();
+	}
+	if (config.getSegmentGeometry() != "standard") {
+		LOG_WARN("Unknown segmentGeometry " << config.getSegmentGeometry() << ", using standard");
+	}
+	return new SevenSegmentOcr<StandardSegmentGeometry>();
+}
@@ -0,0 +1,245 @@
+#include <cmath>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <sstream>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "SyntheticInput.h"
+#include "Log.h"
+
+// Lit segments a to g per digit, bit 0 is segment a.
+static const int SEGMENTS[10] = { 0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F };
+
+static const int BACKGROUND = 40;
+static const int LIT = 210;
+static const int KV_CELLS = 3; // digit cells, e.g. 125
+static const int MA_CELLS = 4; // digit cells, the last one after the decimal point, e.g. 999.9
+
+bool SyntheticOptions::parse(const std::string& spec) {
+	std::istringstream pairs(spec);
+	std::string pair;
+	while (std::getline(pairs, pair, ',')) {
+		size_t eq = pair.find('=');
+		if (eq == std::string::npos) {
+			LOG_ERROR("Expected key=value in synthetic input spec: " << pair);
+			return false;
+		}
+		std::string key = pair.substr(0, eq);
+		const char* value = pair.c_str() + eq + 1;
+		if (key == "width") width = atoi(value);
+		else if (key == "height") height = atoi(value);
+		else if (key == "fps") fps = atof(value);
+		else if (key == "frames") frames = atoi(value);
+		else if (key == "noise") noise = atof(value);
+		else if (key == "blur") blur = atoi(value);
+		else if (key == "drift") drift = atof(value);
+		else if (key == "driftFrames") driftFrames = atoi(value);
+		else if (key == "rotate") rotate = atof(value);
+		else if (key == "change") changeFrames = atoi(value);
+		else if (key == "power") powerFrames = atoi(value);
+		else if (key == "kVMin") kVMin = atof(value);
+		else if (key == "kVMax") kVMax = atof(value);
+		else if (key == "mAMin") mAMin = atof(value);
+		else if (key == "mAMax") mAMax = atof(value);
+		else if (key == "seed") seed = (unsigned) atoi(value);
+		else if (key == "gray") gray = atoi(value) != 0;
+		else if (key == "truth") truthFile = value;
+		else {
+			LOG_ERROR("Unknown key in synthetic input spec: " << key);
+			return false;
+		}
+	}
+	if (width <= 0 || height <= 0 || fps <= 0.) {
+		LOG_ERROR("Synthetic input needs a positive width, height and fps");
+		return false;
+	}
+	// the kV display has KV_CELLS digits, the mA display MA_CELLS digits with one decimal
+	kVMax = std::min(kVMax, std::pow(10., KV_CELLS) - 1.);
+	mAMax = std::min(mAMax, (std::pow(10., MA_CELLS) - 1.) / 10.);
+	if (kVMin < 0. || kVMin > kVMax || mAMin < 0. || mAMin > mAMax) {
+		LOG_ERROR("Invalid kV or mA range in synthetic input spec");
+		return false;
+	}
+	if (blur > 0 && blur % 2 == 0) {
+		blur++;
+	}
+	return true;
+}
+
+SyntheticInput::SyntheticInput(const Config& config, const SyntheticOptions& options) :
+		_options(options), _rng(options.seed) {
+	_img.create(_options.height, _options.width, _options.gray ? CV_8UC1 : CV_8UC3);
+	_canvas.create(_options.height, _options.width, CV_8UC1);
+
+	// digits must pass the height filter of the segmentation
+	int maxHeight = config.getDigitMaxHeight() - 2;
+	cv::Rect frame(0, 0, _options.width, _options.height);
+	if (config.getRoiBoxes().size() >= 3) {
+		_layout = config.getRoiBoxes();
+		// the digits fill 3/4 of the field height and fit the field width
+		_digitHeight = maxHeight;
+		for (int i = 0; i < 2; i++) {
+			int cells = i == 0 ? KV_CELLS : MA_CELLS;
+			_digitHeight = std::min(_digitHeight, _layout[i].height * 3 / 4);
+			_digitHeight = std::min(_digitHeight, (int) (_layout[i].width / (cells * .75 + .5)));
+		}
+	} else {
+		_digitHeight = std::min(maxHeight, std::min(_options.height, _options.width) / 5);
+		_layout = defaultLayout(frame.size(), _digitHeight);
+	}
+	for (const cv::Rect& box : _layout) {
+		if ((box & frame) != box) {
+			LOG_WARN("ROI box " << box << " exceeds the synthetic frame " << frame.size());
+		}
+	}
+	if (_digitHeight <= config.getDigitMinHeight()) {
+		LOG_WARN("Synthetic digits of " << _digitHeight << " px are below digitMinHeight");
+	}
+
+	_startTime = time(nullptr);
+	_truth.frame = -1;
+	nextValues();
+
+	if (!_options.truthFile.empty()) {
+		_truthStream.open(_options.truthFile.c_str());
+		if (!_truthStream) {
+			LOG_ERROR("Failed to open " << _options.truthFile);
+		}
+		_truthStream << "frame,time,power,kV,mA\n";
+	}
+}
+
+bool SyntheticInput::nextImage() {
+	long frame = _truth.frame + 1;
+	if (_options.frames > 0 && frame >= _options.frames) {
+		return false;
+	}
+	_truth.frame = frame;
+	if (frame > 0 && _options.changeFrames > 0 && frame % _options.changeFrames == 0) {
+		nextValues();
+	}
+	_truth.powerOn = _options.powerFrames <= 0 || frame % _options.powerFrames < _options.powerFrames / 2;
+	_time = _startTime + (time_t) (frame / _options.fps);
+	_truth.time = _time;
+
+	render();
+
+	if (_truthStream.is_open()) {
+		_truthStream << frame << ',' << _time << ',' << (_truth.powerOn ? 1 : 0) << ',' << _truth.kV << ','
+				<< _truth.mA << '\n';
+	}
+	// save copy of image if requested
+	if (!_outDir.empty()) {
+		saveImage();
+	}
+	return true;
+}
+
+// Step to new values at random within the ranges, rounded to the display resolution.
+void SyntheticInput::nextValues() {
+	char text[16];
+	_truth.kVValue = std::round(_rng.uniform(_options.kVMin, _options.kVMax));
+	snprintf(text, sizeof(text), "%.0f", _truth.kVValue);
+	_truth.kV = text;
+	_truth.mAValue = std::round(_rng.uniform(_options.mAMin, _options.mAMax) * 10.) / 10.;
+	snprintf(text, sizeof(text), "%.1f", _truth.mAValue);
+	_truth.mA = text;
+}
+
+void SyntheticInput::render() {
+	long frame = _truth.frame;
+	int shift = 0;
+	if (_options.drift > 0. && _options.driftFrames > 0) {
+		shift = (int) std::lround(_options.drift * std::sin(2. * CV_PI * frame / _options.driftFrames));
+	}
+	int background = std::min(255, std::max(0, BACKGROUND + shift));
+	int lit = std::min(255, std::max(0, LIT + shift));
+
+	_canvas.setTo(cv::Scalar(background));
+	drawField(_canvas, _layout[0], _truth.kV, lit);
+	drawField(_canvas, _layout[1], _truth.mA, lit);
+	if (_truth.powerOn) {
+		cv::rectangle(_canvas, _layout.back(), cv::Scalar(lit), cv::FILLED);
+	}
+
+	if (_options.rotate > 0.) {
+		// slow sway around the frame center, over twice the drift period
+		double angle = _options.rotate * std::sin(2. * CV_PI * frame / std::max(1, _options.driftFrames * 2));
+		cv::Point2f center(_canvas.cols / 2.f, _canvas.rows / 2.f);
+		cv::Mat rotation = cv::getRotationMatrix2D(center, angle, 1.);
+		cv::Mat rotated;
+		cv::warpAffine(_canvas, rotated, rotation, _canvas.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT,
+				cv::Scalar(background));
+		_canvas = rotated;
+	}
+	if (_options.blur > 0) {
+		cv::GaussianBlur(_canvas, _canvas, cv::Size(_options.blur, _options.blur), 0);
+	}
+	if (_options.noise > 0.) {
+		// signed noise, added with saturation
+		_noise.create(_canvas.size(), CV_16SC1);
+		_rng.fill(_noise, cv::RNG::NORMAL, 0., _options.noise);
+		cv::add(_canvas, _noise, _canvas, cv::noArray(), CV_8U);
+	}
+
+	if (_options.gray) {
+		_canvas.copyTo(_img);
+	} else {
+		cv::cvtColor(_canvas, _img, cv::COLOR_GRAY2BGR);
+	}
+}
+
+// Draw the text right aligned into the field box. Decimal points sit in the gap before the next digit.
+void SyntheticInput::drawField(cv::Mat& img, const cv::Rect& box, const std::string& text, int lit) {
+	int height = _digitHeight;
+	int width = height / 2;
+	int pitch = width * 3 / 2;
+	int digits = (int) std::count_if(text.begin(), text.end(), ::isdigit);
+	cv::Point origin(box.br().x - height / 4 - digits * pitch + (pitch - width), box.y + (box.height - height) / 2);
+	for (char c : text) {
+		if (c == '.') {
+			int side = std::max(2, width / 5);
+			cv::Rect dot(origin.x - (pitch - width) / 2 - side / 2, origin.y + height - side, side, side);
+			cv::rectangle(img, dot, cv::Scalar(lit), cv::FILLED);
+		} else if (isdigit(c)) {
+			drawDigit(img, origin, width, height, c - '0', lit);
+			origin.x += pitch;
+		}
+	}
+}
+
+// Segments overlap at the corners, so every digit is a single contour.
+void SyntheticInput::drawDigit(cv::Mat& img, cv::Point origin, int width, int height, int digit, int lit) {
+	int t = std::max(2, width / 4);
+	int half = height / 2;
+	const cv::Rect segments[7] = {
+		cv::Rect(0, 0, width, t),                         // a
+		cv::Rect(width - t, 0, t, half + t / 2),          // b
+		cv::Rect(width - t, half - t / 2, t, height - half + t / 2), // c
+		cv::Rect(0, height - t, width, t),                // d
+		cv::Rect(0, half - t / 2, t, height - half + t / 2), // e
+		cv::Rect(0, 0, t, half + t / 2),                  // f
+		cv::Rect(0, half - t / 2, width, t)               // g
+	};
+	for (int s = 0; s < 7; s++) {
+		if (SEGMENTS[digit] & (1 << s)) {
+			cv::rectangle(img, segments[s] + origin, cv::Scalar(lit), cv::FILLED);
+		}
+	}
+}
+
+// kV field above the mA field on the left, the power indicator right of the kV field with
+// room to its right, as the power check reads beyond the box.
+std::vector<cv::Rect> SyntheticInput::defaultLayout(const cv::Size& size, int digitHeight) {
+	int pitch = digitHeight / 2 * 3 / 2;
+	int margin = digitHeight / 2;
+	cv::Point origin(size.width / 8, size.height / 5);
+	std::vector<cv::Rect> layout;
+	layout.push_back(cv::Rect(origin.x, origin.y, KV_CELLS * pitch + margin, digitHeight + margin));
+	layout.push_back(cv::Rect(origin.x, origin.y + 2 * digitHeight, MA_CELLS * pitch + margin, digitHeight + margin));
+	int side = std::max(4, digitHeight / 2);
+	layout.push_back(cv::Rect(layout[0].br().x + digitHeight, origin.y, side, side));
+	return layout;
+}
@@ -0,0 +1,94 @@
+#include <fstream>
+#include <algorithm>
+#include <iomanip>
+#include <cstdio>
+#include <unistd.h>
+
+#include "Trace.h"
+#include "Log.h"
+
+std::atomic<bool> Tracer::_enabled(false);
+std::atomic<uint64_t> Tracer::_frames(0);
+
+// Frame and small id of the calling thread, the ids number the threads in order of their first span.
+static thread_local uint64_t currentFrame = 0;
+static thread_local int currentThread = 0;
+static std::atomic<int> threads(0);
+
+Tracer& Tracer::instance() {
+	static Tracer tracer;
+	return tracer;
+}
+
+void Tracer::start(int capacity) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (capacity <= 0) {
+		return;
+	}
+	if ((int) _spans.size() != capacity) {
+		_spans.assign(capacity, Span());
+	}
+	_next = 0;
+	_enabled.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::stop() {
+	_enabled.store(false, std::memory_order_relaxed);
+}
+
+void Tracer::beginFrame() {
+	if (enabled()) {
+		currentFrame = _frames.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+}
+
+void Tracer::record(const char* name, Clock::time_point start, Clock::time_point end) {
+	if (currentThread == 0) {
+		currentThread = threads.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_spans.empty()) {
+		return;
+	}
+	Span& span = _spans[_next % _spans.size()];
+	span.name = name;
+	span.frame = currentFrame;
+	span.startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+	span.durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	span.thread = currentThread;
+	_next++;
+}
+
+// Complete events ("ph":"X") with microsecond times, the frame id as argument.
+void Tracer::write(std::ostream& os) const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	const uint64_t size = _spans.size();
+	const uint64_t count = std::min<uint64_t>(_next, size);
+	const int pid = (int) getpid();
+	os << std::fixed << std::setprecision(3);
+	os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	for (uint64_t i = 0; i < count; i++) {
+		const Span& span = _spans[(_next - count + i) % size];
+		os << (i ? ",\n" : "\n") << "{\"name\":\"" << span.name << "\",\"cat\":\"knnocr\",\"ph\":\"X\",\"pid\":" << pid
+				<< ",\"tid\":" << span.thread << ",\"ts\":" << span.startNs * 1e-3 << ",\"dur\":"
+				<< span.durationNs * 1e-3;
+		if (span.frame) {
+			os << ",\"args\":{\"frame\":" << span.frame << "}";
+		}
+		os << "}";
+	}
+	os << "\n]}\n";
+}
+
+// Write the trace to a temporary file and rename it, readers never see a partial trace.
+bool Tracer::dump(const std::string& filename) const {
+	std::string tmp = filename + ".tmp";
+	std::ofstream ofs(tmp.c_str());
+	write(ofs);
+	ofs.close();
+	if (!ofs || rename(tmp.c_str(), filename.c_str()) != 0) {
+		LOG_ERROR("Failed to write trace to " << filename);
+		return false;
+	}
+	return true;
+}
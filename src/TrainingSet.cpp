@@ -0,0 +1,84 @@
+#include <string>
+#include <list>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+#include "Directory.h"
+#include "TrainingSet.h"
+
+// Add a directory-per-class folder or a CSV manifest.
+bool TrainingSet::add(const std::string& source) {
+	struct stat st;
+	if (stat(source.c_str(), &st) != 0) {
+		std::cerr << "Training source not found: " << source << std::endl;
+		return false;
+	}
+	if (S_ISDIR(st.st_mode)) {
+		return addDirectory(source);
+	}
+	return addManifest(source);
+}
+
+// Add all png crops below <path>/0 .. <path>/9 and <path>/dot (or <path>/.).
+bool TrainingSet::addDirectory(const std::string& path) {
+	const char* classes[] = { "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "dot", "." };
+	size_t count = _files.size();
+
+	for (const char* cls : classes) {
+		std::string dirname = path + "/" + cls;
+		char label = (cls[1] == 0) ? cls[0] : '.';
+		Directory directory(dirname.c_str(), ".png");
+		std::list<std::string> files = directory.list();
+		files.sort();
+		for (const std::string& file : files) {
+			_files.push_back(directory.fullpath(file));
+			_labels.push_back(label);
+		}
+	}
+	return _files.size() > count;
+}
+
+// Add crops listed in a CSV manifest with lines "<image path>,<label>".
+// Relative paths are resolved against the directory of the manifest.
+bool TrainingSet::addManifest(const std::string& filename) {
+	std::ifstream ifs(filename);
+	if (!ifs.is_open()) {
+		std::cerr << "Failed to open manifest " << filename << std::endl;
+		return false;
+	}
+	std::string base;
+	size_t slash = filename.find_last_of('/');
+	if (slash != std::string::npos) {
+		base = filename.substr(0, slash + 1);
+	}
+
+	size_t count = _files.size();
+	std::string line;
+	int lineNo = 0;
+	while (std::getline(ifs, line)) {
+		lineNo++;
+		if (!line.empty() && line[line.size()-1] == '\r') {
+			line.erase(line.size()-1);
+		}
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		size_t comma = line.find_last_of(',');
+		if (comma == std::string::npos || comma + 2 != line.size() || !isLabel(line[comma+1])) {
+			std::cerr << filename << ":" << lineNo << ": expected <path>,<0-9|.>" << std::endl;
+			continue;
+		}
+		std::string path = line.substr(0, comma);
+		if (path[0] != '/') {
+			path = base + path;
+		}
+		_files.push_back(path);
+		_labels.push_back(line[comma+1]);
+	}
+	return _files.size() > count;
+}
+
+bool TrainingSet::isLabel(char label) {
+	return (label >= '0' && label <= '9') || label == '.';
+}
@@ -0,0 +1,197 @@
+#include <string>
+#include <ctime>
+#include <cstdio>
+#include <glob.h>
+#include <sys/stat.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "VideoRecorder.h"
+#include "Metrics.h"
+#include "Log.h"
+
+VideoRecorder::VideoRecorder(const std::string& basename, double fps, int queueSize, DropPolicy policy) :
+		_basename(basename), _fps(fps), _policy(policy), _maxBytes(0), _maxSeconds(0), _keepFiles(0),
+		_slots(std::max(1, queueSize)), _head(0), _count(0), _running(false), _written(0), _dropped(0),
+		_opened(0), _failed(false) {
+}
+
+VideoRecorder::~VideoRecorder() {
+	stop();
+}
+
+// Start a new file when the current one reaches maxBytes or maxSeconds, 0 = never.
+// Of the rotated files the newest keepFiles are kept, 0 = all.
+void VideoRecorder::setRotation(long maxBytes, int maxSeconds, int keepFiles) {
+	_maxBytes = maxBytes;
+	_maxSeconds = maxSeconds;
+	_keepFiles = keepFiles;
+}
+
+// Record only this part of the frames, empty = whole frame.
+void VideoRecorder::setRoi(const cv::Rect& roi) {
+	_roi = roi;
+}
+
+void VideoRecorder::start() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_running) {
+		return;
+	}
+	_running = true;
+	_thread = std::thread(&VideoRecorder::run, this);
+}
+
+// Encode the frames still queued and close the file.
+void VideoRecorder::stop() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_running) {
+			return;
+		}
+		_running = false;
+	}
+	_cond.notify_all();
+	_thread.join();
+}
+
+// Queue a frame for recording. Never blocks on the encoder.
+void VideoRecorder::write(const cv::Mat& frame) {
+	if (frame.empty()) {
+		return;
+	}
+	const cv::Mat src = _roi.area() > 0 ? frame(_roi & cv::Rect(0, 0, frame.cols, frame.rows)) : frame;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!_running) {
+		return;
+	}
+	const int size = (int) _slots.size();
+	if (_count == size) {
+		_dropped++;
+		Metrics::instance().recorderDropped.inc();
+		if (_policy == DROP_NEWEST) {
+			return;
+		}
+		_head = (_head + 1) % size;
+		_count--;
+	}
+	// copyTo reuses the slot buffer once it has the frame size
+	src.copyTo(_slots[(_head + _count) % size]);
+	_count++;
+	_cond.notify_one();
+}
+
+long VideoRecorder::getFramesWritten() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _written;
+}
+
+long VideoRecorder::getFramesDropped() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _dropped;
+}
+
+VideoRecorder::DropPolicy VideoRecorder::parseDropPolicy(const std::string& policy) {
+	return policy == "newest" ? DROP_NEWEST : DROP_OLDEST;
+}
+
+// Encoder thread.
+void VideoRecorder::run() {
+	cv::Mat frame, color;
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true) {
+		_cond.wait(lock, [this] { return _count > 0 || !_running; });
+		if (_count == 0) {
+			break;
+		}
+		// take the frame out of the ring and leave our old buffer in its place
+		std::swap(frame, _slots[_head]);
+		_head = (_head + 1) % (int) _slots.size();
+		_count--;
+		lock.unlock();
+
+		bool ok = false;
+		if (!_failed) {
+			if (!_writer.isOpened() || rotationDue()) {
+				openFile(frame.size());
+			}
+			if (_writer.isOpened()) {
+				TraceSpan span("encode");
+				// the writer takes BGR, luma inputs deliver gray frames
+				if (frame.channels() == 1) {
+					cv::cvtColor(frame, color, cv::COLOR_GRAY2BGR);
+					_writer.write(color);
+				} else {
+					_writer.write(frame);
+				}
+				ok = true;
+			}
+		}
+
+		lock.lock();
+		if (ok) {
+			_written++;
+		} else {
+			_dropped++;
+			Metrics::instance().recorderDropped.inc();
+		}
+	}
+	lock.unlock();
+	_writer.release();
+}
+
+bool VideoRecorder::openFile(const cv::Size& size) {
+	_writer.release();
+
+	time(&_opened);
+	if (_maxBytes > 0 || _maxSeconds > 0) {
+		struct tm date;
+		char stamp[32];
+		localtime_r(&_opened, &date);
+		strftime(stamp, sizeof(stamp), "-%Y%m%d-%H%M%S", &date);
+		_filename = _basename + stamp + ".avi";
+	} else {
+		_filename = _basename + ".avi";
+	}
+
+	int fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+	_writer.open(_filename, fourcc, _fps, size, true);
+	if (!_writer.isOpened()) {
+		// keep the OCR running, just stop recording
+		LOG_ERROR("Recording Initialization Error: " << _filename);
+		_failed = true;
+		return false;
+	}
+	LOG_INFO("Recording to " << _filename);
+	removeOldFiles();
+	return true;
+}
+
+// Delete the oldest rotated files, earlier runs included. The time stamps in the names
+// sort like the times, the file just opened is the newest.
+void VideoRecorder::removeOldFiles() {
+	if (_keepFiles <= 0 || (_maxBytes <= 0 && _maxSeconds <= 0)) {
+		return;
+	}
+	glob_t files;
+	std::string pattern = _basename + "-[0-9]*-[0-9]*.avi";
+	if (glob(pattern.c_str(), 0, nullptr, &files) != 0) {
+		return;
+	}
+	for (size_t i = 0; i + _keepFiles < files.gl_pathc; i++) {
+		if (remove(files.gl_pathv[i]) == 0) {
+			LOG_INFO("Removed old recording " << files.gl_pathv[i]);
+		} else {
+			LOG_WARN("Failed to remove old recording " << files.gl_pathv[i]);
+		}
+	}
+	globfree(&files);
+}
+
+bool VideoRecorder::rotationDue() {
+	if (_maxSeconds > 0 && time(0) - _opened >= _maxSeconds) {
+		return true;
+	}
+	struct stat st;
+	return _maxBytes > 0 && stat(_filename.c_str(), &st) == 0 && st.st_size >= _maxBytes;
+}
@@ -0,0 +1,65 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+#include "ReadingBus.h"
+
+// Follow the readings published by knnocr on the shared memory bus.
+int main(int argc, char** argv) {
+	std::string name = "/knnocr";
+	bool fromStart = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:ah")) != -1) {
+		switch (opt) {
+			case 'n':
+				name = optarg;
+				break;
+			case 'a':
+				fromStart = true;
+				break;
+			default:
+				std::cout << "Usage: " << argv[0] << " [-n <bus name>] [-a]\n";
+				std::cout << "  -n <name> : shared memory name (default /knnocr).\n";
+				std::cout << "  -a : print all records still in the ring, not only new ones.\n";
+				return 1;
+		}
+	}
+
+	ReadingBusReader reader(name);
+	while (!reader.open()) {
+		std::cerr << "Waiting for reading bus " << name << "...\n";
+		sleep(1);
+	}
+	if (!fromStart) {
+		reader.seekToEnd();
+	}
+
+	BusRecord record;
+	uint64_t lost = 0;
+	while (true) {
+		if (!reader.next(record)) {
+			usleep(10000);
+			continue;
+		}
+		if (reader.getLost() != lost) {
+			std::cout << "# lost " << reader.getLost() - lost << " records\n";
+			lost = reader.getLost();
+		}
+		time_t seconds = record.timeNs / 1000000000;
+		struct tm date;
+		char stamp[32];
+		localtime_r(&seconds, &date);
+		strftime(stamp, sizeof(stamp), "%H:%M:%S", &date);
+
+		std::cout << stamp << "." << std::setw(3) << std::setfill('0') << (record.timeNs / 1000000) % 1000
+				<< std::setfill(' ') << " frame " << record.frame << (record.powerOn ? " ON " : " OFF")
+				<< " kV " << std::string(record.kVDigits, strnlen(record.kVDigits, BusRecord::MAX_DIGITS))
+				<< (record.kVChecked ? "*" : "")
+				<< " mA " << std::string(record.mADigits, strnlen(record.mADigits, BusRecord::MAX_DIGITS))
+				<< (record.mAChecked ? "*" : "") << std::endl;
+	}
+	return 0;
+}